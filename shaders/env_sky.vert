@@ -9,5 +9,6 @@ void main(){
     vUV = vec2((gl_VertexID == 1) ? 2.0 : 0.0,
                (gl_VertexID == 2) ? 2.0 : 0.0);
     vec2 pos = vUV * 2.0 - 1.0;
-    gl_Position = vec4(pos, 0.0, 1.0);
+    // on the far plane: drawn after opaque geometry, covered pixels fail the depth test
+    gl_Position = vec4(pos, 1.0, 1.0);
 }
\ No newline at end of file
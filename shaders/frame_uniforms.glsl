@@ -0,0 +1,15 @@
+// Per-frame values shared by pbr, shadow and sky (binding 0, std140; mirrors
+// FrameUniforms in renderer.cpp). ShaderProgram inserts this file after the
+// #version line of every shader it loads from disk.
+layout(std140) uniform FrameUniforms {
+    mat4 uViewProj;
+    mat4 uLightVP[4];    // per shadow cascade
+    mat4 uCameraBasis;   // columns: right, up, forward
+    vec4 uCameraPos;     // xyz
+    vec4 uLightDir;      // xyz: direction from light to scene
+    vec4 uLightColor;    // rgb intensity
+    vec4 uAmbientColor;  // rgb
+    vec4 uEnvStrength;   // x = specular IBL scale, y = diffuse IBL scale, z = highest specular mip
+    vec4 uCascadeSplits; // far view depth of each cascade
+    vec4 uEnvSH[9];      // irradiance / pi, see EnvironmentMap::irradianceSH
+};
@@ -3,38 +3,27 @@ in vec3 vNormal;
 in vec2 vUV;
 in vec3 vTangent;
 in float vTangentW;
-in vec4 vLightSpacePos;
 in vec3 vWorldPos;
 
 out vec4 FragColor;
 
+// Permutation features, #defined per variant (PbrFeature in assimp_model.h):
+// HAS_ROUGH_METAL, HAS_OCCLUSION, HAS_NORMAL_MAP, BOX_UV, OVERRIDE_ROUGHNESS, OVERRIDE_METALLIC
+
 uniform sampler2D uBaseColorTex; // unit 0 (sRGB)
-uniform sampler2D uORMTex;       // unit 1 (R=AO, G=Roughness, B=Metallic)
+uniform sampler2D uRoughMetalTex; // unit 1 (R=Roughness, G=Metallic)
 uniform sampler2D uNormalTex;    // unit 2
-uniform sampler2D uEnvEquirect;  // unit 4 (linear HDR)
-uniform int uHasORM;
-uniform int uHasNormal;
-uniform sampler2D uRoughnessTex; // unit 5 (optional separate roughness)
-uniform sampler2D uMetalnessTex; // unit 6 (optional separate metalness)
-uniform int uHasRoughness;
-uniform int uHasMetalness;
-
-uniform vec3 uLightDir;   // direction from light to scene (sun direction)
-uniform vec3 uLightColor; // intensity (can be >1)
-uniform vec3 uAmbientColor;
+uniform samplerCube uEnvSpecular; // unit 4 (linear HDR cubemap, GGX-prefiltered per mip)
+uniform sampler2D uBrdfLut;      // unit 5 (split-sum scale/bias over NdotV, roughness)
+uniform sampler2D uOcclusionTex; // unit 6 (R=AO)
+
 uniform vec4 uBaseColorFactor; // material base color factor
-uniform sampler2DShadow uShadowMap;
-uniform mat4 uLightBias; // usually bias * lightMVP in vertex, but we’ll compute here with vLightSpacePos
-uniform vec3 uCameraPos;
+uniform sampler2DArrayShadow uShadowMap; // one layer per cascade
 uniform float uMetallicFactor;   // from material
 uniform float uRoughnessFactor;  // from material
-uniform float uEnvSpecStrength;  // scale for specular IBL
-uniform float uEnvDiffStrength;  // scale for diffuse IBL
-uniform float uOverrideRoughness; // < 0 to ignore, else force [0,1]
-uniform float uOverrideMetallic;  // < 0 to ignore, else force [0,1]
-// Box projection controls (for voxel visualization)
-uniform int uUseBoxUVMapping;     // 0 = use mesh UVs, 1 = box-project using world pos
-uniform float uBoxUVScale;        // tiles per meter (e.g., 1.0 = 1 repeat per meter)
+uniform float uOverrideRoughness; // OVERRIDE_ROUGHNESS: forced roughness [0,1]
+uniform float uOverrideMetallic;  // OVERRIDE_METALLIC: forced metallic [0,1]
+uniform float uBoxUVScale;        // BOX_UV: tiles per meter (e.g., 1.0 = 1 repeat per meter)
 
 const float PI = 3.14159265;
 
@@ -51,28 +40,26 @@ mat3 makeTBN(vec3 N, vec3 T, float handedness)
 	return mat3(t, b, n);
 }
 
-	// Convert direction to equirectangular UV
-	vec2 dirToEquirect(vec3 d){
-		float phi = atan(d.z, d.x);
-		float theta = acos(clamp(d.y, -1.0, 1.0));
-		float u = phi / (2.0*PI) + 0.5;
-		u = fract(u); // wrap to [0,1)
-		vec2 uv = vec2(u, theta / PI);
-		// half-texel offset on U to avoid border sampling causing seams
-		vec2 texel = 1.0 / vec2(textureSize(uEnvEquirect, 0));
-		uv.x = fract(uv.x + 0.5 * texel.x);
-		return uv;
-	}
+// SH9 irradiance / PI (coefficients pre-convolved on the CPU)
+vec3 envIrradiance(vec3 n)
+{
+	vec3 e = uEnvSH[0].rgb
+		+ uEnvSH[1].rgb * n.y + uEnvSH[2].rgb * n.z + uEnvSH[3].rgb * n.x
+		+ uEnvSH[4].rgb * (n.x * n.y) + uEnvSH[5].rgb * (n.y * n.z) + uEnvSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+		+ uEnvSH[7].rgb * (n.x * n.z) + uEnvSH[8].rgb * (n.x * n.x - n.y * n.y);
+	return max(e, vec3(0.0));
+}
 
 void main() {
 	vec3 N = normalize(vNormal);
-	vec3 L = normalize(-uLightDir);
-	vec3 V = normalize(uCameraPos - vWorldPos);
+	vec3 L = normalize(-uLightDir.xyz);
+	vec3 V = normalize(uCameraPos.xyz - vWorldPos);
 	vec3 H = normalize(L + V);
 
 	// Choose UVs: mesh UVs or box-projected from world position
 	vec2 baseUV = vUV;
-	if (uUseBoxUVMapping == 1) {
+#ifdef BOX_UV
+	{
 		vec3 an = abs(N);
 		if (an.x >= an.y && an.x >= an.z) {
 			baseUV = vWorldPos.zy;
@@ -83,47 +70,50 @@ void main() {
 		}
 		baseUV *= uBoxUVScale;
 	}
+#endif
 
 	vec3 albedo = texture(uBaseColorTex, baseUV).rgb * uBaseColorFactor.rgb;
 	float metallic = clamp(uMetallicFactor, 0.0, 1.0);
 	float roughness = clamp(uRoughnessFactor, 0.04, 1.0);
 	float ao = 1.0;
-	if (uHasORM == 1) {
-		vec3 orm = texture(uORMTex, vUV).rgb;
-		ao = orm.r;
-		roughness = clamp(orm.g * uRoughnessFactor, 0.04, 1.0);
-		metallic = clamp(orm.b * uMetallicFactor, 0.0, 1.0);
-	}
-	else {
-		if (uHasRoughness == 1) {
-			float r = texture(uRoughnessTex, vUV).r;
-			roughness = clamp(r * uRoughnessFactor, 0.04, 1.0);
-		}
-		if (uHasMetalness == 1) {
-			float m = texture(uMetalnessTex, vUV).r;
-			metallic = clamp(m * uMetallicFactor, 0.0, 1.0);
-		}
-	}
+#ifdef HAS_ROUGH_METAL
+	vec2 rm = texture(uRoughMetalTex, vUV).rg;
+	roughness = clamp(rm.r * uRoughnessFactor, 0.04, 1.0);
+	metallic = clamp(rm.g * uMetallicFactor, 0.0, 1.0);
+#endif
+#ifdef HAS_OCCLUSION
+	ao = texture(uOcclusionTex, vUV).r;
+#endif
 
 	// Optional global overrides for quick tuning of untextured assets
-	if (uOverrideRoughness >= 0.0) {
-		roughness = clamp(uOverrideRoughness, 0.04, 1.0);
-	}
-	if (uOverrideMetallic >= 0.0) {
-		metallic = clamp(uOverrideMetallic, 0.0, 1.0);
-	}
-
-	if (uHasNormal == 1) {
-		vec3 nrm = texture(uNormalTex, vUV).xyz * 2.0 - 1.0;
+#ifdef OVERRIDE_ROUGHNESS
+	roughness = clamp(uOverrideRoughness, 0.04, 1.0);
+#endif
+#ifdef OVERRIDE_METALLIC
+	metallic = clamp(uOverrideMetallic, 0.0, 1.0);
+#endif
+
+#ifdef HAS_NORMAL_MAP
+	{
+		// X/Y only (BC5 normal maps carry two channels); Z is rebuilt on the hemisphere
+		vec2 nxy = texture(uNormalTex, vUV).xy * 2.0 - 1.0;
+		vec3 nrm = vec3(nxy, sqrt(max(1.0 - dot(nxy, nxy), 0.0)));
 		mat3 TBN = makeTBN(N, vTangent, vTangentW);
 		N = normalize(TBN * nrm);
 		H = normalize(L + V);
 	}
+#endif
 
 	float NdotL = max(dot(N, L), 0.0);
-	// Shadow: transform to shadow map space (bias matrix is 0.5* + 0.5)
-	vec3 projCoords = vLightSpacePos.xyz / max(vLightSpacePos.w, 1e-6);
-	projCoords = projCoords * 0.5 + 0.5;
+	// Shadow: pick the cascade by view depth, then transform to its map space (bias matrix is 0.5* + 0.5)
+	float viewDepth = dot(vWorldPos - uCameraPos.xyz, uCameraBasis[2].xyz);
+	int cascade = 0;
+	while (cascade < 4 && viewDepth > uCascadeSplits[cascade]) ++cascade;
+	vec3 projCoords = vec3(2.0);
+	if (cascade < 4) {
+		vec4 lightSpacePos = uLightVP[cascade] * vec4(vWorldPos, 1.0);
+		projCoords = lightSpacePos.xyz / max(lightSpacePos.w, 1e-6) * 0.5 + 0.5;
+	}
 	// Percentage-closer filtering (3x3)
 	float shadow = 0.0;
 	if (projCoords.z <= 1.0) {
@@ -134,7 +124,7 @@ void main() {
 		for (int x = -1; x <= 1; ++x) {
 			for (int y = -1; y <= 1; ++y) {
 				vec2 offs = vec2(x, y) * texel;
-				shadow += texture(uShadowMap, vec3(projCoords.xy + offs, projCoords.z - dynamicBias));
+				shadow += texture(uShadowMap, vec4(projCoords.xy + offs, float(cascade), projCoords.z - dynamicBias));
 			}
 		}
 		shadow /= 9.0;
@@ -161,48 +151,16 @@ void main() {
 	vec3 kd = (1.0 - F) * (1.0 - metallic);
 	vec3 diffuse = kd * albedo / PI;
 
-	vec3 color = (diffuse + spec) * uLightColor * NdotL * ao * shadow + uAmbientColor * albedo * ao;
-
-	// Simple IBL: sample environment for diffuse and specular components
-	vec2 uvN = dirToEquirect(N);
-	// Cross-fade across seam for diffuse sample
-	float seamW = 1.5 / float(textureSize(uEnvEquirect, 0).x); // ~1.5 texels
-	vec3 envDiff;
-	if (uvN.x < seamW) {
-		vec3 c0 = texture(uEnvEquirect, uvN).rgb;
-		vec3 c1 = texture(uEnvEquirect, vec2(uvN.x + 1.0, uvN.y)).rgb;
-		float t = smoothstep(0.0, seamW, uvN.x);
-		envDiff = mix(c1, c0, t);
-	} else if (uvN.x > 1.0 - seamW) {
-		vec3 c0 = texture(uEnvEquirect, uvN).rgb;
-		vec3 c1 = texture(uEnvEquirect, vec2(uvN.x - 1.0, uvN.y)).rgb;
-		float t = smoothstep(1.0, 1.0 - seamW, uvN.x);
-		envDiff = mix(c1, c0, t);
-	} else {
-		envDiff = texture(uEnvEquirect, uvN).rgb;
-	}
-	float kd_ibl = (1.0 - metallic); // simple energy term for IBL
-	vec3 diffuseIBL = kd_ibl * (albedo / PI) * envDiff * uEnvDiffStrength;
+	vec3 color = (diffuse + spec) * uLightColor.rgb * NdotL * ao * shadow + uAmbientColor.rgb * albedo * ao;
+
+	// Image-based lighting: SH irradiance for diffuse, split-sum prefiltered specular
+	vec3 Fr = F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotV, 5.0);
+	vec3 diffuseIBL = (1.0 - Fr) * (1.0 - metallic) * albedo * envIrradiance(N) * uEnvStrength.y;
 	vec3 R = reflect(-V, N);
-	vec2 uvR = dirToEquirect(R);
-	vec3 envSpec;
-	if (uvR.x < seamW) {
-		vec3 c0 = texture(uEnvEquirect, uvR).rgb;
-		vec3 c1 = texture(uEnvEquirect, vec2(uvR.x + 1.0, uvR.y)).rgb;
-		float t = smoothstep(0.0, seamW, uvR.x);
-		envSpec = mix(c1, c0, t);
-	} else if (uvR.x > 1.0 - seamW) {
-		vec3 c0 = texture(uEnvEquirect, uvR).rgb;
-		vec3 c1 = texture(uEnvEquirect, vec2(uvR.x - 1.0, uvR.y)).rgb;
-		float t = smoothstep(1.0, 1.0 - seamW, uvR.x);
-		envSpec = mix(c1, c0, t);
-	} else {
-		envSpec = texture(uEnvEquirect, uvR).rgb;
-	}
-	vec3 specColor = mix(vec3(0.05), albedo, metallic); // slightly boosted dielectric F0
-	float gloss = pow(1.0 - roughness, 2.2);
-	float dielectricBoost = mix(1.8, 1.0, metallic); // boost dielectrics so reflections are visible
-	vec3 specIBL = envSpec * specColor * gloss * dielectricBoost * uEnvSpecStrength;
-	color += (diffuseIBL * (1.0 - metallic) + specIBL) * ao;
+	// mip l holds GGX prefiltered at roughness l / (levels - 1): roughness maps linearly onto the chain
+	vec3 prefiltered = textureLod(uEnvSpecular, R, roughness * uEnvStrength.z).rgb;
+	vec2 envBRDF = texture(uBrdfLut, vec2(NdotV, roughness)).rg;
+	vec3 specIBL = prefiltered * (F0 * envBRDF.x + envBRDF.y) * uEnvStrength.x;
+	color += (diffuseIBL + specIBL) * ao;
 	FragColor = vec4(color, 1.0);
 }
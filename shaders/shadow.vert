@@ -3,9 +3,10 @@ layout (location=0) in vec3 aPos;
 layout (location=1) in vec3 aNormal;
 layout (location=2) in vec2 aUV;
 layout (location=3) in vec4 aTangent;
+layout (location=4) in mat4 aModel; // per-instance, see InstanceBuffer
 
-uniform mat4 uLightMVP;
+uniform int uCascade; // which uLightVP this pass renders
 
 void main(){
-    gl_Position = uLightMVP * vec4(aPos,1.0);
+    gl_Position = uLightVP[uCascade] * (aModel * vec4(aPos,1.0));
 }
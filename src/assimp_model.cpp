@@ -1,101 +1,345 @@
 #include "assimp_model.h"
+#include "model_cache.h"
 #include "shader.h"
+#include "gl_state.h"
+#include "instance_buffer.h"
+#include "mesh_optimizer.h"
+#include "profiler.h"
+#include "texture_streamer.h"
+#include "vertex_format.h"
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#include <stb_image.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <cstring>
 #include <filesystem>
+#include <functional>
 #include <cstdio>
+#include <unordered_map>
 
-// Interleaved layout: pos(3), normal(3), uv(2), tangent(4)
-static void make_vao(const std::vector<float> &interleaved, const std::vector<uint32_t> &indices, AMeshPrimitive &out)
+// ImproveCacheLocality is left out: cookFromAssimp reorders with MeshOptimizer instead
+static const unsigned kImportFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenNormals |
+                                     aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_GenUVCoords |
+                                     aiProcess_SortByPType | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph | aiProcess_PreTransformVertices;
+
+// pos, normal, uv, tangent (w = bitangent sign): 24 bytes
+using ModelVertex = VertexLayout<vertex::Float3, vertex::Snorm10x3, vertex::Half2, vertex::Snorm10x3Sign>;
+
+// Remembers every file the importer opens, so external buffers become cache dependencies
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    using Assimp::DefaultIOSystem::Open;
+    Assimp::IOStream *Open(const char *file, const char *mode) override
+    {
+        Assimp::IOStream *stream = Assimp::DefaultIOSystem::Open(file, mode);
+        if (stream && std::find(opened.begin(), opened.end(), file) == opened.end())
+            opened.push_back(file);
+        return stream;
+    }
+    std::vector<std::string> opened;
+};
+
+static void make_vao(const CookedMesh &mesh, AMeshPrimitive &out)
 {
     glGenVertexArrays(1, &out.vao);
-    glBindVertexArray(out.vao);
+    glState().bindVertexArray(out.vao);
     glGenBuffers(1, &out.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, out.vbo);
-    glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(float), interleaved.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)mesh.vertexBytes, mesh.vertices, GL_STATIC_DRAW);
     glGenBuffers(1, &out.ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, out.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
-    out.indexCount = (GLsizei)indices.size();
-    out.indexType = GL_UNSIGNED_INT;
-    const GLsizei stride = 12 * sizeof(float);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void *)(8 * sizeof(float)));
-    glBindVertexArray(0);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)mesh.indexBytes, mesh.indices, GL_STATIC_DRAW);
+    out.indexCount = (GLsizei)mesh.indexCount;
+    out.indexType = mesh.indexType;
+    ModelVertex::setup();
+    glState().bindVertexArray(0);
 }
 
-void AssimpModel::clear()
+// Decodes each distinct (image, usage) pair once into mipped, optionally block
+// compressed texels. get()/getOcclusionRoughMetal() only reserve slots; decodeAll() then
+// decodes and encodes every slot in parallel.
+struct TextureCooker
 {
-    if (defaultWhiteTex_) { glDeleteTextures(1, &defaultWhiteTex_); defaultWhiteTex_ = 0; }
-    for (auto &m : meshes_)
+    struct Source
     {
-        if (m.ebo)
-            glDeleteBuffers(1, &m.ebo);
-        if (m.vbo)
-            glDeleteBuffers(1, &m.vbo);
-        if (m.vao)
-            glDeleteVertexArrays(1, &m.vao);
+        const aiTexture *embedded = nullptr;
+        std::string path;
+        TextureUsage usage = TextureUsage::Color;
+        bool raw = false; // only read as a channel of a packed slot
+        // packed slot: raw source slot per channel (-1 = fill)
+        bool packed = false;
+        int channelCount = 0;
+        int channelSource[2] = {-1, -1};
+        int channel[2] = {0, 0};
+        uint8_t fill[2] = {255, 255};
+    };
+
+    CookedModel &model;
+    const aiScene *scene;
+    std::filesystem::path baseDir;
+    bool compress;
+    std::unordered_map<std::string, int> cooked;
+    std::vector<Source> sources;
+
+    int get(const aiMaterial *aim, aiTextureType type, TextureUsage usage)
+    {
+        aiString t;
+        if (aim->GetTexture(type, 0, &t) != AI_SUCCESS)
+            return -1;
+        return reserve(t.C_Str(), usage, false);
     }
-    meshes_.clear();
-    for (auto &mat : materials_)
+
+    // Occlusion and roughness/metalness become two linear slots: occlusion
+    // alone (Mask) and roughness + metalness in R/G (Data), whether they come
+    // from one packed image or from split maps. A missing roughness or
+    // metalness map is filled with its scalar factor, which then drops to 1
+    // since the shader still multiplies by it.
+    void getOcclusionRoughMetal(const aiMaterial *aim, CookedMaterial &m)
     {
-        if (mat.baseColorTex)
-            glDeleteTextures(1, &mat.baseColorTex);
-        if (mat.ormTex)
-            glDeleteTextures(1, &mat.ormTex);
-        if (mat.normalTex)
-            glDeleteTextures(1, &mat.normalTex);
-        if (mat.roughnessTex)
-            glDeleteTextures(1, &mat.roughnessTex);
-        if (mat.metalnessTex)
-            glDeleteTextures(1, &mat.metalnessTex);
+        aiString names[3];
+        bool has[3] = {false, false, false};
+        int channel[3] = {0, 0, 0};
+        // occlusion is always R; glTF2 reports occlusionTexture as LIGHTMAP
+        for (aiTextureType type : {aiTextureType_AMBIENT_OCCLUSION, aiTextureType_LIGHTMAP})
+            if (!has[0])
+                has[0] = aim->GetTexture(type, 0, &names[0]) == AI_SUCCESS;
+        // glTF2 metallicRoughness is reported as UNKNOWN (G = roughness, B = metalness)
+        if (aim->GetTexture(aiTextureType_UNKNOWN, 0, &names[1]) == AI_SUCCESS)
+        {
+            names[2] = names[1];
+            has[1] = has[2] = true;
+            channel[1] = 1;
+            channel[2] = 2;
+        }
+        else
+        {
+            has[1] = aim->GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &names[1]) == AI_SUCCESS;
+            has[2] = aim->GetTexture(aiTextureType_METALNESS, 0, &names[2]) == AI_SUCCESS;
+            // one image for both already uses the glTF layout
+            if (has[1] && has[2] && std::strcmp(names[1].C_Str(), names[2].C_Str()) == 0)
+            {
+                channel[1] = 1;
+                channel[2] = 2;
+            }
+        }
+        if (has[0])
+        {
+            m.occlusionTex = packed(TextureUsage::Mask, 1, &names[0], &has[0], &channel[0], nullptr);
+            std::fprintf(stderr, "AssimpModel: material \"%s\" occlusion from %s (R)%s\n", aim->GetName().C_Str(), names[0].C_Str(),
+                         has[1] && std::strcmp(names[0].C_Str(), names[1].C_Str()) != 0 ? ", split from roughness/metalness" : "");
+        }
+        if (has[1] || has[2])
+        {
+            const float factor[2] = {m.roughnessFactor, m.metallicFactor};
+            m.roughMetalTex = packed(TextureUsage::Data, 2, &names[1], &has[1], &channel[1], factor);
+            if (!has[1])
+                m.roughnessFactor = 1.0f;
+            if (!has[2])
+                m.metallicFactor = 1.0f;
+        }
     }
-    materials_.clear();
-}
 
-bool AssimpModel::load(const std::string &path)
-{
-    clear();
-    // Create fallback white texture (sRGB)
-    if (!defaultWhiteTex_) {
-        glGenTextures(1, &defaultWhiteTex_);
-        glBindTexture(GL_TEXTURE_2D, defaultWhiteTex_);
-        unsigned char white[4] = {255,255,255,255};
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // One slot built from `count` single channels of other images; a missing
+    // one is filled with its factor
+    int packed(TextureUsage usage, int count, const aiString *names, const bool *has, const int *channel, const float *factor)
+    {
+        Source src;
+        src.usage = usage;
+        src.packed = true;
+        src.channelCount = count;
+        std::string key = "packed" + std::to_string((uint32_t)usage);
+        for (int i = 0; i < count; ++i)
+        {
+            if (has[i])
+            {
+                src.channelSource[i] = reserve(names[i].C_Str(), usage, true);
+                src.channel[i] = channel[i];
+                key += ":" + std::to_string(src.channelSource[i]) + "." + std::to_string(src.channel[i]);
+            }
+            else
+            {
+                src.fill[i] = (uint8_t)std::lround(std::min(std::max(factor ? factor[i] : 1.0f, 0.0f), 1.0f) * 255.0f);
+                key += ":=" + std::to_string(src.fill[i]);
+            }
+        }
+        auto it = cooked.find(key);
+        if (it != cooked.end())
+            return it->second;
+        sources.push_back(src);
+        cooked.emplace(key, (int)sources.size() - 1);
+        return (int)sources.size() - 1;
     }
+
+    int reserve(const char *name, TextureUsage usage, bool raw)
+    {
+        const std::string key = (raw ? std::string("raw") : std::to_string((uint32_t)usage)) + ":" + name;
+        auto it = cooked.find(key);
+        if (it != cooked.end())
+            return it->second;
+        Source src;
+        src.embedded = scene->GetEmbeddedTexture(name);
+        if (!src.embedded)
+            src.path = (baseDir / name).string();
+        src.usage = usage;
+        src.raw = raw;
+        sources.push_back(src);
+        int index = (int)sources.size() - 1;
+        cooked.emplace(key, index);
+        return index;
+    }
+
+    // Returns slot -> final texture index (-1 where decoding failed). Slots whose
+    // bytes hash the same (same image under two names) share one texture.
+    std::vector<int> decodeAll()
+    {
+        const size_t n = sources.size();
+        std::vector<MappedFile> files(n);
+        std::vector<const uint8_t *> bytes(n, nullptr);
+        std::vector<size_t> sizes(n, 0);
+        std::vector<uint64_t> hashes(n, 0);
+        auto parallelFor = [n](const std::function<void(size_t)> &fn) {
+            std::atomic<size_t> next{0};
+            auto work = [&] {
+                PROFILE_SCOPE("cookFromAssimp textures");
+                for (size_t i; (i = next++) < n;)
+                    fn(i);
+            };
+            std::vector<std::thread> threads;
+            const size_t threadCount = std::min<size_t>(n, std::max(1u, std::thread::hardware_concurrency()));
+            for (size_t t = 1; t < threadCount; ++t)
+                threads.emplace_back(work);
+            work();
+            for (auto &t : threads)
+                t.join();
+        };
+
+        parallelFor([&](size_t i) {
+            const Source &src = sources[i];
+            if (src.packed)
+                return;
+            if (src.embedded)
+            {
+                bytes[i] = reinterpret_cast<const uint8_t *>(src.embedded->pcData);
+                sizes[i] = src.embedded->mHeight == 0 ? src.embedded->mWidth : (size_t)src.embedded->mWidth * src.embedded->mHeight;
+            }
+            else if (files[i].open(src.path))
+            {
+                bytes[i] = files[i].data();
+                sizes[i] = files[i].size();
+            }
+            if (bytes[i])
+                hashes[i] = hashBytes(bytes[i], sizes[i]);
+        });
+
+        // first slot with each (content, usage) decodes; the rest alias it
+        std::vector<size_t> owner(n);
+        std::unordered_map<uint64_t, size_t> firstByHash;
+        for (size_t i = 0; i < n; ++i)
+        {
+            owner[i] = i;
+            if (!bytes[i])
+                continue;
+            if (files[i].data()) // external file: re-cook when it changes
+            {
+                CookedDependency dep{sources[i].path, hashes[i], {}};
+                statFile(dep.path, dep.stamp);
+                model.dependencies.push_back(std::move(dep));
+            }
+            if (sources[i].raw)
+                continue;
+            auto ins = firstByHash.emplace(hashes[i] ^ ((uint64_t)sources[i].usage * 0x9e3779b97f4a7c15ull), i);
+            owner[i] = ins.first->second;
+        }
+
+        std::vector<CookedModel> local(n);
+        std::vector<CookedTexture> results(n);
+        std::vector<uint8_t> ok(n, 0);
+        parallelFor([&](size_t i) {
+            const Source &src = sources[i];
+            if (src.packed)
+            {
+                // a channel whose image is missing reads as 1 (times the material factor)
+                PackedChannel channels[2];
+                for (int c = 0; c < src.channelCount; ++c)
+                {
+                    const int from = src.channelSource[c];
+                    channels[c].fill = from >= 0 ? 255 : src.fill[c];
+                    if (from < 0 || !bytes[from])
+                        continue;
+                    channels[c].encoded = bytes[from];
+                    channels[c].size = sizes[from];
+                    channels[c].channel = src.channel[c];
+                }
+                ok[i] = cookPackedImage(local[i], results[i], channels, src.channelCount, src.usage, compress);
+            }
+            else if (owner[i] == i && bytes[i] && !src.raw)
+                ok[i] = cookImage(local[i], results[i], bytes[i], sizes[i], src.usage, compress);
+        });
+
+        std::vector<int> remap(n, -1);
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (owner[i] != i)
+            {
+                remap[i] = remap[owner[i]];
+                continue;
+            }
+            if (!ok[i])
+                continue;
+            // moving the blobs keeps their heap buffers, so mip pointers stay valid
+            for (auto &blob : local[i].storage)
+                model.storage.push_back(std::move(blob));
+            remap[i] = (int)model.textures.size();
+            model.textures.push_back(std::move(results[i]));
+        }
+        return remap;
+    }
+};
+
+// Run the Assimp import and convert the scene into GPU-ready blobs
+static bool cookFromAssimp(const std::string &path, const CookKey &key, CookedModel &out)
+{
+    PROFILE_SCOPE("cookFromAssimp");
     Assimp::Importer importer;
-    unsigned flags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_GenNormals |
-                     aiProcess_CalcTangentSpace | aiProcess_FlipUVs | aiProcess_GenUVCoords | aiProcess_ImproveCacheLocality |
-                     aiProcess_SortByPType | aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph | aiProcess_PreTransformVertices;
-    const aiScene *scene = importer.ReadFile(path, flags);
+    auto *io = new RecordingIOSystem; // owned by the importer
+    importer.SetIOHandler(io);
+    const aiScene *scene = importer.ReadFile(path, kImportFlags);
     if (!scene || !scene->mRootNode)
         return false;
+    // files the importer read besides the source (glTF .bin buffers, .mtl, ...)
+    for (const std::string &opened : io->opened)
+    {
+        if (opened == path)
+            continue;
+        CookedDependency dep{opened, 0, {}};
+        if (hashFile(opened, dep.hash) && statFile(opened, dep.stamp))
+            out.dependencies.push_back(std::move(dep));
+    }
     std::filesystem::path p(path);
-    baseDir_ = p.has_parent_path() ? p.parent_path().string() : std::string(".");
+    TextureCooker textures{out, scene, p.has_parent_path() ? p.parent_path() : std::filesystem::path("."),
+                           (key.cookFlags & CookKey::kCompressTextures) != 0, {}, {}};
 
     // Materials
-    materials_.resize(scene->mNumMaterials);
+    out.materials.resize(scene->mNumMaterials);
     for (unsigned mi = 0; mi < scene->mNumMaterials; ++mi)
     {
         const aiMaterial *aim = scene->mMaterials[mi];
-        auto &dst = materials_[mi];
+        auto &dst = out.materials[mi];
         aiColor4D col;
         if (AI_SUCCESS == aim->Get(AI_MATKEY_BASE_COLOR, col))
         {
-            dst.baseColorFactor = {col.r, col.g, col.b, col.a};
+            dst.baseColorFactor[0] = col.r;
+            dst.baseColorFactor[1] = col.g;
+            dst.baseColorFactor[2] = col.b;
+            dst.baseColorFactor[3] = col.a;
         }
         // glTF2 metallic/roughness scalar factors
         float mf = dst.metallicFactor, rf = dst.roughnessFactor;
@@ -105,103 +349,26 @@ bool AssimpModel::load(const std::string &path)
             dst.roughnessFactor = rf;
 
         // Base color texture (fallback to DIFFUSE if needed)
-        unsigned texCountBC = aim->GetTextureCount(aiTextureType_BASE_COLOR);
-        if (texCountBC == 0) texCountBC = aim->GetTextureCount(aiTextureType_DIFFUSE);
-        if (texCountBC > 0)
-        {
-            aiString t;
-            if (aim->GetTexture(aiTextureType_BASE_COLOR, 0, &t) != AI_SUCCESS) {
-                aim->GetTexture(aiTextureType_DIFFUSE, 0, &t);
-            }
-            const aiTexture *emb = scene->GetEmbeddedTexture(t.C_Str());
-            if (emb)
-                dst.baseColorTex = loadTextureFromAssimp(emb, true);
-            else
-                dst.baseColorTex = loadTextureFromFile((std::filesystem::path(baseDir_) / t.C_Str()).string(), true);
-            dst.hasBaseColor = dst.baseColorTex != 0;
-        }
-        // ORM (occlusion-roughness-metallic) often exported as UNKNOWN for glTF2 in Assimp
-        if (aim->GetTextureCount(aiTextureType_UNKNOWN) > 0)
-        {
-            aiString t;
-            aim->GetTexture(aiTextureType_UNKNOWN, 0, &t);
-            const aiTexture *emb = scene->GetEmbeddedTexture(t.C_Str());
-            if (emb)
-                dst.ormTex = loadTextureFromAssimp(emb, false);
-            else
-                dst.ormTex = loadTextureFromFile((std::filesystem::path(baseDir_) / t.C_Str()).string(), false);
-            dst.hasORM = dst.ormTex != 0;
-        }
-        // Optional separate roughness/metalness
-        if (aim->GetTextureCount(aiTextureType_DIFFUSE_ROUGHNESS) > 0)
-        {
-            aiString t; aim->GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &t);
-            const aiTexture *emb = scene->GetEmbeddedTexture(t.C_Str());
-            dst.roughnessTex = emb ? loadTextureFromAssimp(emb, false) : loadTextureFromFile((std::filesystem::path(baseDir_) / t.C_Str()).string(), false);
-            dst.hasRoughness = dst.roughnessTex != 0;
-        }
-        if (aim->GetTextureCount(aiTextureType_METALNESS) > 0)
-        {
-            aiString t; aim->GetTexture(aiTextureType_METALNESS, 0, &t);
-            const aiTexture *emb = scene->GetEmbeddedTexture(t.C_Str());
-            dst.metalnessTex = emb ? loadTextureFromAssimp(emb, false) : loadTextureFromFile((std::filesystem::path(baseDir_) / t.C_Str()).string(), false);
-            dst.hasMetalness = dst.metalnessTex != 0;
-        }
+        dst.baseColorTex = textures.get(aim, aiTextureType_BASE_COLOR, TextureUsage::Color);
+        if (dst.baseColorTex < 0)
+            dst.baseColorTex = textures.get(aim, aiTextureType_DIFFUSE, TextureUsage::Color);
+        // Occlusion (BC4) and roughness/metalness (BC5), split out of packed ORM or repacked from separate maps
+        textures.getOcclusionRoughMetal(aim, dst);
         // Normal map
-        if (aim->GetTextureCount(aiTextureType_NORMALS) > 0)
-        {
-            aiString t;
-            aim->GetTexture(aiTextureType_NORMALS, 0, &t);
-            const aiTexture *emb = scene->GetEmbeddedTexture(t.C_Str());
-            if (emb)
-                dst.normalTex = loadTextureFromAssimp(emb, false);
-            else
-                dst.normalTex = loadTextureFromFile((std::filesystem::path(baseDir_) / t.C_Str()).string(), false);
-            dst.hasNormal = dst.normalTex != 0;
-        }
-
-    // Debug log per material
-    std::fprintf(stderr,
-             "Material %u: baseColor=%d orm=%d roughnessTex=%d metalnessTex=%d normal=%d | mf=%.3f rf=%.3f\n",
-             mi,
-             dst.hasBaseColor ? 1 : 0,
-             dst.hasORM ? 1 : 0,
-             dst.hasRoughness ? 1 : 0,
-             dst.hasMetalness ? 1 : 0,
-             dst.hasNormal ? 1 : 0,
-             dst.metallicFactor,
-             dst.roughnessFactor);
+        dst.normalTex = textures.get(aim, aiTextureType_NORMALS, TextureUsage::Normal);
     }
+    const std::vector<int> remap = textures.decodeAll();
+    for (auto &m : out.materials)
+        for (int32_t *slot : {&m.baseColorTex, &m.occlusionTex, &m.roughMetalTex, &m.normalTex})
+            if (*slot >= 0)
+                *slot = remap[*slot];
 
     // Iterate meshes already pre-transformed to world due to PreTransformVertices
-    meshes_.reserve(scene->mNumMeshes);
     for (unsigned i = 0; i < scene->mNumMeshes; ++i)
     {
         const aiMesh *mesh = scene->mMeshes[i];
         if (!mesh->HasPositions())
             continue;
-        std::vector<float> interleaved;
-        interleaved.resize(mesh->mNumVertices * 12);
-        for (unsigned v = 0; v < mesh->mNumVertices; ++v)
-        {
-            const aiVector3D &p = mesh->mVertices[v];
-            const aiVector3D n = mesh->HasNormals() ? mesh->mNormals[v] : aiVector3D(0, 0, 1);
-            aiVector3D uv = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][v] : aiVector3D(0, 0, 0);
-            aiVector3D tan = mesh->HasTangentsAndBitangents() ? mesh->mTangents[v] : aiVector3D(1, 0, 0);
-            float tanW = 1.0f; // sign; Assimp doesn't directly expose handedness; assume +1
-            interleaved[v * 12 + 0] = p.x;
-            interleaved[v * 12 + 1] = p.y;
-            interleaved[v * 12 + 2] = p.z;
-            interleaved[v * 12 + 3] = n.x;
-            interleaved[v * 12 + 4] = n.y;
-            interleaved[v * 12 + 5] = n.z;
-            interleaved[v * 12 + 6] = uv.x;
-            interleaved[v * 12 + 7] = uv.y;
-            interleaved[v * 12 + 8] = tan.x;
-            interleaved[v * 12 + 9] = tan.y;
-            interleaved[v * 12 + 10] = tan.z;
-            interleaved[v * 12 + 11] = tanW;
-        }
         std::vector<uint32_t> indices;
         indices.reserve(mesh->mNumFaces * 3);
         for (unsigned f = 0; f < mesh->mNumFaces; ++f)
@@ -214,114 +381,286 @@ bool AssimpModel::load(const std::string &path)
                 indices.push_back(face.mIndices[2]);
             }
         }
-        AMeshPrimitive prim{};
-        make_vao(interleaved, indices, prim);
-        prim.materialIndex = (int)mesh->mMaterialIndex;
-        meshes_.push_back(prim);
+        if (indices.empty())
+            continue; // point/line meshes split off by SortByPType
+
+        // Post-transform cache order, then overdraw-aware cluster order, then
+        // renumber vertices by first use (which also drops unreferenced ones)
+        const size_t vertexCount = mesh->mNumVertices;
+        std::vector<glm::vec3> positions(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            positions[v] = glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+        const float acmrBefore = MeshOptimizer::acmr(indices.data(), indices.size(), vertexCount);
+        MeshOptimizer::optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+        MeshOptimizer::optimizeOverdraw(indices.data(), indices.size(), positions.data(), vertexCount);
+        const std::vector<uint32_t> remap = MeshOptimizer::optimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+        const float acmrAfter = MeshOptimizer::acmr(indices.data(), indices.size(), vertexCount);
+
+        size_t usedCount = 0;
+        for (uint32_t r : remap)
+            usedCount += r != MeshOptimizer::kUnused;
+        std::vector<ModelVertex::Vertex> vertices(usedCount);
+        glm::vec3 lo(0.0f), hi(0.0f);
+        bool first = true;
+        for (unsigned v = 0; v < mesh->mNumVertices; ++v)
+        {
+            if (remap[v] == MeshOptimizer::kUnused)
+                continue;
+            const aiVector3D n = mesh->HasNormals() ? mesh->mNormals[v] : aiVector3D(0, 0, 1);
+            aiVector3D uv = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][v] : aiVector3D(0, 0, 0);
+            aiVector3D tan = mesh->HasTangentsAndBitangents() ? mesh->mTangents[v] : aiVector3D(1, 0, 0);
+            // handedness: does the stored bitangent agree with cross(n, t)?
+            float tanW = 1.0f;
+            if (mesh->HasTangentsAndBitangents() && ((n ^ tan) * mesh->mBitangents[v]) < 0.0f)
+                tanW = -1.0f;
+            vertices[remap[v]] = ModelVertex::pack(positions[v], glm::vec3(n.x, n.y, n.z), glm::vec2(uv.x, uv.y),
+                                                   glm::vec4(tan.x, tan.y, tan.z, tanW));
+            if (first)
+                lo = hi = positions[v];
+            lo = glm::min(lo, positions[v]);
+            hi = glm::max(hi, positions[v]);
+            first = false;
+        }
+        std::vector<uint8_t> vertexBlob(vertices.size() * sizeof(ModelVertex::Vertex));
+        std::memcpy(vertexBlob.data(), vertices.data(), vertexBlob.size());
+
+        // 16-bit indices whenever every vertex is addressable
+        const bool shortIndices = usedCount <= 65536;
+        std::vector<uint8_t> indexBlob;
+        if (shortIndices)
+        {
+            std::vector<uint16_t> narrow(indices.begin(), indices.end());
+            indexBlob.resize(narrow.size() * sizeof(uint16_t));
+            std::memcpy(indexBlob.data(), narrow.data(), indexBlob.size());
+        }
+        else
+        {
+            indexBlob.resize(indices.size() * sizeof(uint32_t));
+            std::memcpy(indexBlob.data(), indices.data(), indexBlob.size());
+        }
+        std::fprintf(stderr, "Mesh %u: %zu tris, %zu verts, ACMR %.3f -> %.3f, %d-bit indices\n", i, indices.size() / 3, usedCount,
+                     acmrBefore, acmrAfter, shortIndices ? 16 : 32);
+
+        CookedMesh m;
+        m.vertexStride = (uint32_t)ModelVertex::kStride;
+        m.indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        m.indexCount = (uint32_t)indices.size();
+        m.materialIndex = (int32_t)mesh->mMaterialIndex;
+        for (int a = 0; a < 3; ++a)
+        {
+            m.boundsMin[a] = lo[a];
+            m.boundsMax[a] = hi[a];
+        }
+        m.vertexBytes = vertexBlob.size();
+        m.vertices = out.keep(std::move(vertexBlob));
+        m.indexBytes = indexBlob.size();
+        m.indices = out.keep(std::move(indexBlob));
+        out.meshes.push_back(m);
     }
-    return !meshes_.empty();
+    return !out.meshes.empty();
 }
 
-void AssimpModel::draw(const ShaderProgram &shader) const
+void AssimpModel::clear()
 {
-    for (const auto &m : meshes_)
+    GLState &gs = glState();
+    defaultWhite_.reset();
+    for (auto &m : meshes_)
     {
-        if (m.materialIndex >= 0 && m.materialIndex < (int)materials_.size())
-        {
-            const auto &mat = materials_[m.materialIndex];
-            // bind samplers once per draw
-            shader.set1i("uBaseColorTex", 0);
-            shader.set1i("uORMTex", 1);
-            shader.set1i("uNormalTex", 2);
-            // Optional separate textures
-            shader.set1i("uRoughnessTex", 5);
-            shader.set1i("uMetalnessTex", 6);
-            if (mat.baseColorTex)
-            {
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, mat.baseColorTex);
-            } else if (defaultWhiteTex_) {
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, defaultWhiteTex_);
-            }
-            if (mat.ormTex)
-            {
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, mat.ormTex);
-            }
-            if (mat.roughnessTex)
-            {
-                glActiveTexture(GL_TEXTURE5);
-                glBindTexture(GL_TEXTURE_2D, mat.roughnessTex);
-            }
-            if (mat.metalnessTex)
-            {
-                glActiveTexture(GL_TEXTURE6);
-                glBindTexture(GL_TEXTURE_2D, mat.metalnessTex);
-            }
-            if (mat.normalTex)
-            {
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, mat.normalTex);
-            }
-            shader.set1i("uHasORM", mat.hasORM ? 1 : 0);
-            shader.set1i("uHasNormal", mat.hasNormal ? 1 : 0);
-            shader.set1i("uHasRoughness", mat.hasRoughness ? 1 : 0);
-            shader.set1i("uHasMetalness", mat.hasMetalness ? 1 : 0);
-            shader.set4f("uBaseColorFactor", mat.baseColorFactor.r, mat.baseColorFactor.g, mat.baseColorFactor.b, mat.baseColorFactor.a);
-            shader.set1f("uMetallicFactor", mat.metallicFactor);
-            shader.set1f("uRoughnessFactor", mat.roughnessFactor);
-        }
-        glBindVertexArray(m.vao);
-        glDrawElements(GL_TRIANGLES, m.indexCount, m.indexType, 0);
+        gs.forgetVertexArray(m.vao);
+        if (m.ebo)
+            glDeleteBuffers(1, &m.ebo);
+        if (m.vbo)
+            glDeleteBuffers(1, &m.vbo);
+        if (m.vao)
+            glDeleteVertexArrays(1, &m.vao);
     }
-    glBindVertexArray(0);
+    meshes_.clear();
+    textures_.clear(); // the cache deletes textures no other model holds
+    materials_.clear();
 }
 
-GLuint AssimpModel::loadTextureFromAssimp(const aiTexture *tex, bool srgb) const
+bool AssimpModel::load(const std::string &path)
 {
-    if (!tex)
-        return 0;
-    int w = 0, h = 0, c = 0;
-    unsigned char *data = nullptr;
-    if (tex->mHeight == 0)
+    PROFILE_SCOPE("AssimpModel::load");
+    clear();
+    defaultWhite_ = textureCache().white();
+    const auto t0 = std::chrono::steady_clock::now();
+    auto elapsedMs = [&] { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+
+    CookKey key;
+    key.importFlags = kImportFlags;
+    // BC5 is core, but BC1/BC3 need S3TC; without it every texture stays uncompressed
+    if (GLAD_GL_EXT_texture_compression_s3tc)
+        key.cookFlags |= CookKey::kCompressTextures;
+    key.sourcePath = path;
+    if (!statFile(path, key.sourceStamp))
+        return false;
+    const std::string cachePath = path + ".qmc";
+    // The mapping (or the freshly cooked data) stays alive until every texture has streamed in
+    auto file = std::make_shared<MappedFile>();
+    CookedModel cooked;
+    if (file->open(cachePath) && readCookedModel(*file, key, cooked))
     {
-        data = stbi_load_from_memory(reinterpret_cast<const unsigned char *>(tex->pcData), (int)tex->mWidth, &w, &h, &c, 0);
+        upload(cooked, file);
+        std::fprintf(stderr, "AssimpModel: %s from cache in %.1f ms\n", path.c_str(), elapsedMs());
+        textureCache().logStats();
+        return !meshes_.empty();
+    }
+    file.reset();
+    if (!hashFile(path, key.sourceHash))
+        return false;
+    auto fresh = std::make_shared<CookedModel>();
+    if (!cookFromAssimp(path, key, *fresh))
+        return false;
+    if (!writeCookedModel(cachePath, key, *fresh))
+        std::fprintf(stderr, "AssimpModel: could not write %s\n", cachePath.c_str());
+    upload(*fresh, fresh);
+    std::fprintf(stderr, "AssimpModel: %s imported and cooked in %.1f ms\n", path.c_str(), elapsedMs());
+    textureCache().logStats();
+    return !meshes_.empty();
+}
+
+void AssimpModel::upload(const CookedModel &cooked, std::shared_ptr<const void> pixels)
+{
+    PROFILE_SCOPE("AssimpModel::upload");
+    // Placeholders by first use, so unloaded textures read as neutral inputs
+    static const uint8_t kWhite[4] = {255, 255, 255, 255}, kFlatNormal[4] = {128, 128, 255, 255}, kDielectric[4] = {255, 0, 0, 255};
+    auto hasTexture = [&](int32_t index) { return index >= 0 && (size_t)index < cooked.textures.size(); };
+    std::vector<const uint8_t *> placeholder(cooked.textures.size(), kWhite);
+    for (auto it = cooked.materials.rbegin(); it != cooked.materials.rend(); ++it)
+    {
+        if (hasTexture(it->normalTex))
+            placeholder[it->normalTex] = kFlatNormal;
+        if (hasTexture(it->roughMetalTex))
+            placeholder[it->roughMetalTex] = kDielectric;
+    }
+    textures_.resize(cooked.textures.size());
+    for (size_t i = 0; i < cooked.textures.size(); ++i)
+    {
+        const CookedTexture &tex = cooked.textures[i];
+        size_t bytes = 0;
+        for (const CookedMip &mip : tex.mips)
+            bytes += (size_t)mip.bytes;
+        textures_[i] = textureCache().acquire({tex.contentHash, tex.srgb}, bytes, [&] {
+            return textureStreamer().request(
+                [pixels, tex](CookedModel &, CookedTexture &out) {
+                    // touch every page on the worker so the GL thread never faults on the mapping
+                    volatile uint8_t sink = 0;
+                    for (const CookedMip &mip : tex.mips)
+                        for (uint64_t off = 0; off < mip.bytes; off += 4096)
+                            sink = sink + mip.data[off];
+                    out = tex;
+                    return true;
+                },
+                placeholder[i]);
+        });
+    }
+
+    auto texture = [&](int32_t index) -> GLuint { return hasTexture(index) ? textures_[index].id() : 0; };
+    materials_.resize(cooked.materials.size());
+    for (size_t mi = 0; mi < cooked.materials.size(); ++mi)
+    {
+        const CookedMaterial &src = cooked.materials[mi];
+        auto &dst = materials_[mi];
+        dst.baseColorFactor = {src.baseColorFactor[0], src.baseColorFactor[1], src.baseColorFactor[2], src.baseColorFactor[3]};
+        dst.metallicFactor = src.metallicFactor;
+        dst.roughnessFactor = src.roughnessFactor;
+        dst.baseColorTex = texture(src.baseColorTex);
+        dst.occlusionTex = texture(src.occlusionTex);
+        dst.roughMetalTex = texture(src.roughMetalTex);
+        dst.normalTex = texture(src.normalTex);
+        dst.hasBaseColor = dst.baseColorTex != 0;
+        dst.hasOcclusion = dst.occlusionTex != 0;
+        dst.hasRoughMetal = dst.roughMetalTex != 0;
+        dst.hasNormal = dst.normalTex != 0;
+        dst.features = (dst.hasOcclusion ? kPbrOcclusion : 0u) | (dst.hasRoughMetal ? kPbrRoughMetal : 0u) | (dst.hasNormal ? kPbrNormalMap : 0u);
+
+    // Debug log per material
+    std::fprintf(stderr,
+             "Material %zu: baseColor=%d occlusion=%d roughMetal=%d normal=%d | mf=%.3f rf=%.3f\n",
+             mi,
+             dst.hasBaseColor ? 1 : 0,
+             dst.hasOcclusion ? 1 : 0,
+             dst.hasRoughMetal ? 1 : 0,
+             dst.hasNormal ? 1 : 0,
+             dst.metallicFactor,
+             dst.roughnessFactor);
     }
-    else
+
+    meshes_.reserve(cooked.meshes.size());
+    for (const CookedMesh &mesh : cooked.meshes)
     {
-        data = stbi_load_from_memory(reinterpret_cast<const unsigned char *>(tex->pcData), (int)(tex->mWidth * tex->mHeight), &w, &h, &c, 0);
+        AMeshPrimitive prim{};
+        make_vao(mesh, prim);
+        prim.materialIndex = mesh.materialIndex;
+        prim.boundsMin = glm::vec3(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]);
+        prim.boundsMax = glm::vec3(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]);
+        if (meshes_.empty())
+        {
+            boundsMin_ = prim.boundsMin;
+            boundsMax_ = prim.boundsMax;
+        }
+        boundsMin_ = glm::min(boundsMin_, prim.boundsMin);
+        boundsMax_ = glm::max(boundsMax_, prim.boundsMax);
+        meshes_.push_back(prim);
     }
-    if (!data)
-        return 0;
-    GLenum internal = (c == 4) ? (srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8) : (srgb ? GL_SRGB8 : GL_RGB8);
-    GLenum format = (c == 4) ? GL_RGBA : GL_RGB;
-    GLuint id = 0;
-    glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal, w, h, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    stbi_image_free(data);
-    return id;
 }
 
-GLuint AssimpModel::loadTextureFromFile(const std::string &path, bool srgb) const
+AMaterialUniforms AMaterialUniforms::resolve(const ShaderProgram &shader)
+{
+    AMaterialUniforms u;
+    u.baseColorFactor = shader.uniform("uBaseColorFactor");
+    u.metallicFactor = shader.uniform("uMetallicFactor");
+    u.roughnessFactor = shader.uniform("uRoughnessFactor");
+    return u;
+}
+
+void AssimpModel::bindMaterial(const ShaderProgram &shader, const AMaterialUniforms &u, int materialIndex) const
 {
-    int w = 0, h = 0, c = 0;
-    unsigned char *data = stbi_load(path.c_str(), &w, &h, &c, 0);
-    if (!data)
-        return 0;
-    GLenum internal = (c == 4) ? (srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8) : (srgb ? GL_SRGB8 : GL_RGB8);
-    GLenum format = (c == 4) ? GL_RGBA : GL_RGB;
-    GLuint id = 0;
-    glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal, w, h, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    stbi_image_free(data);
-    return id;
+    // Depth-only programs have no material inputs; skip texture binds entirely
+    if (u.baseColorFactor < 0 || materialIndex < 0 || materialIndex >= (int)materials_.size())
+        return;
+    GLState &gs = glState();
+    const auto &mat = materials_[materialIndex];
+    if (mat.baseColorTex)
+        gs.bindTexture(0, GL_TEXTURE_2D, mat.baseColorTex);
+    else if (defaultWhite_)
+        gs.bindTexture(0, GL_TEXTURE_2D, defaultWhite_.id());
+    if (mat.roughMetalTex)
+        gs.bindTexture(1, GL_TEXTURE_2D, mat.roughMetalTex);
+    if (mat.normalTex)
+        gs.bindTexture(2, GL_TEXTURE_2D, mat.normalTex);
+    if (mat.occlusionTex)
+        gs.bindTexture(6, GL_TEXTURE_2D, mat.occlusionTex);
+    shader.set4f(u.baseColorFactor, mat.baseColorFactor.r, mat.baseColorFactor.g, mat.baseColorFactor.b, mat.baseColorFactor.a);
+    shader.set1f(u.metallicFactor, mat.metallicFactor);
+    shader.set1f(u.roughnessFactor, mat.roughnessFactor);
+}
+
+void AssimpModel::drawPrimitive(size_t index, const InstanceBuffer &instances) const
+{
+    const auto &m = meshes_[index];
+    glState().bindVertexArray(m.vao);
+    instances.attachTo(m.instanceSource);
+    glDrawElementsInstanced(GL_TRIANGLES, m.indexCount, m.indexType, 0, instances.count());
+}
+
+void AssimpModel::draw(const ShaderProgram &shader, const InstanceBuffer &instances, const uint8_t *primitiveVisible) const
+{
+    if (instances.count() == 0)
+        return;
+    // Resolve handles once per call; sampler units are assigned by the renderer at init
+    const AMaterialUniforms u = AMaterialUniforms::resolve(shader);
+    int boundMaterial = -2; // meshes sharing a material skip its binds and uploads
+    for (size_t i = 0; i < meshes_.size(); ++i)
+    {
+        if (primitiveVisible && !primitiveVisible[i])
+            continue;
+        if (meshes_[i].materialIndex != boundMaterial)
+        {
+            bindMaterial(shader, u, meshes_[i].materialIndex);
+            boundMaterial = meshes_[i].materialIndex;
+        }
+        drawPrimitive(i, instances);
+    }
 }
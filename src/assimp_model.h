@@ -1,6 +1,9 @@
 #pragma once
 #include <glad/gl.h>
 #include <glm/glm.hpp>
+#include "texture_cache.h"
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -10,38 +13,82 @@ struct AMeshPrimitive
     GLsizei indexCount = 0;
     GLenum indexType = GL_UNSIGNED_INT;
     int materialIndex = -1;
+    glm::vec3 boundsMin{0.0f}, boundsMax{0.0f}; // model space
+    mutable uint32_t instanceSource = 0; // InstanceBuffer the VAO's instance attributes point at
 };
 
+// pbr.frag permutation bits; bit i compiles the variant with
+// "#define kPbrFeatureNames[i]". Materials supply the texture bits, the
+// renderer the rest.
+enum PbrFeature : uint32_t
+{
+    kPbrRoughMetal = 1u << 0,        // roughness/metallic texture
+    kPbrNormalMap = 1u << 1,         // tangent-space normal map
+    kPbrBoxUV = 1u << 2,             // UVs box-projected from world position (voxel surface)
+    kPbrOverrideRoughness = 1u << 3, // uOverrideRoughness replaces the material's
+    kPbrOverrideMetallic = 1u << 4,  // uOverrideMetallic replaces the material's (tuning only)
+    kPbrOcclusion = 1u << 5,         // ambient occlusion texture
+};
+inline const char *const kPbrFeatureNames[] = {"HAS_ROUGH_METAL", "HAS_NORMAL_MAP", "BOX_UV", "OVERRIDE_ROUGHNESS", "OVERRIDE_METALLIC", "HAS_OCCLUSION"};
+
+// Texture names are held by AssimpModel::textures_ and may be shared between materials
+// (and, through the TextureCache, between models).
+// They stream in (see TextureStreamer) and sample a neutral placeholder until loaded.
 struct AMaterial
 {
     GLuint baseColorTex = 0; // sRGB
-    GLuint ormTex = 0;       // linear, (R=occlusion, G=roughness, B=metallic)
+    GLuint occlusionTex = 0; // linear, R=occlusion
+    GLuint roughMetalTex = 0; // linear, R=roughness, G=metallic
     GLuint normalTex = 0;    // normal map (tangent space)
-    GLuint roughnessTex = 0; // linear, if provided separately
-    GLuint metalnessTex = 0; // linear, if provided separately
     glm::vec4 baseColorFactor{1, 1, 1, 1};
     float metallicFactor = 0.0f;  // glTF dielectrics default to non-metal
     float roughnessFactor = 0.5f;  // moderate roughness as a practical default
     bool hasBaseColor = false;
-    bool hasORM = false;
+    bool hasOcclusion = false;
+    bool hasRoughMetal = false;
     bool hasNormal = false;
-    bool hasRoughness = false;
-    bool hasMetalness = false;
+    uint32_t features = 0; // PbrFeature bits this material's textures need
+};
+
+// Material uniform locations in one program; all -1 for depth-only programs
+struct AMaterialUniforms
+{
+    GLint baseColorFactor = -1, metallicFactor = -1, roughnessFactor = -1;
+    static AMaterialUniforms resolve(const class ShaderProgram &shader);
 };
 
 class AssimpModel
 {
 public:
+    // Loads from the cooked sidecar (<path>.qmc) when it matches the source and
+    // import flags; otherwise imports through Assimp and writes the sidecar.
     bool load(const std::string &path);
-    void draw(const class ShaderProgram &shader) const;
+    // One glDrawElementsInstanced per primitive covering every instance in the buffer.
+    // primitiveVisible (optional, one entry per primitive) skips culled primitives.
+    void draw(const class ShaderProgram &shader, const class InstanceBuffer &instances, const uint8_t *primitiveVisible = nullptr) const;
+
+    // Pieces of draw() for callers that order primitives themselves (see RenderQueue)
+    void bindMaterial(const class ShaderProgram &shader, const AMaterialUniforms &u, int materialIndex) const;
+    void drawPrimitive(size_t index, const class InstanceBuffer &instances) const;
+
+    const std::vector<AMeshPrimitive> &primitives() const { return meshes_; }
+    // PbrFeature bits for a primitive's material (0 without one)
+    uint32_t materialFeatures(int materialIndex) const
+    {
+        return materialIndex >= 0 && materialIndex < (int)materials_.size() ? materials_[materialIndex].features : 0u;
+    }
+    // Union of the primitive bounds, model space
+    const glm::vec3 &boundsMin() const { return boundsMin_; }
+    const glm::vec3 &boundsMax() const { return boundsMax_; }
 
 private:
     std::vector<AMeshPrimitive> meshes_;
     std::vector<AMaterial> materials_;
-    std::string baseDir_;
+    std::vector<TextureHandle> textures_;
+    glm::vec3 boundsMin_{0.0f}, boundsMax_{0.0f};
     // Fallbacks
-    GLuint defaultWhiteTex_ = 0; // sRGB white for albedo when no texture
+    TextureHandle defaultWhite_; // sRGB white for albedo when no texture
     void clear();
-    GLuint loadTextureFromAssimp(const struct aiTexture *tex, bool srgb) const;
-    GLuint loadTextureFromFile(const std::string &path, bool srgb) const;
+    // `pixels` owns the memory the cooked texture levels point into while they stream
+    void upload(const struct CookedModel &cooked, std::shared_ptr<const void> pixels);
 };
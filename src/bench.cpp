@@ -0,0 +1,281 @@
+#include "bench.h"
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include "environment.h"
+#include "gl_state.h"
+#include "gpu_pass_timer.h"
+#include "level.h"
+#include "profiler.h"
+#include "renderer.h"
+#include "texture_streamer.h"
+#include "voxel_world.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+const int kWarmupFrames = 30;        // untimed: shader binaries, caches, driver warm-up
+const int kMaxStreamingFrames = 600; // untimed: wait for streamed textures to land
+
+// Headless first: GLFW's null platform with EGL uses Mesa's surfaceless
+// platform, so no display server is needed (llvmpipe included). Without it,
+// a hidden window on the native platform.
+GLFWwindow *createContext(int width, int height)
+{
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        const bool headless = attempt == 0;
+        glfwInitHint(GLFW_PLATFORM, headless ? GLFW_PLATFORM_NULL : GLFW_ANY_PLATFORM);
+        if (!glfwInit())
+            continue;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        if (headless)
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        if (GLFWwindow *window = glfwCreateWindow(width, height, "Qoom bench", nullptr, nullptr))
+        {
+            std::fprintf(stderr, "Bench: %s context\n", headless ? "surfaceless EGL" : "hidden window");
+            return window;
+        }
+        glfwTerminate();
+    }
+    return nullptr;
+}
+
+struct Summary
+{
+    double mean = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+};
+
+Summary summarize(std::vector<double> v)
+{
+    Summary s;
+    if (v.empty())
+        return s;
+    std::sort(v.begin(), v.end());
+    // nearest rank
+    auto pct = [&](double p) { return v[std::min(v.size() - 1, (size_t)std::ceil(p * v.size()) - (p > 0 ? 1 : 0))]; };
+    for (double x : v)
+        s.mean += x;
+    s.mean /= (double)v.size();
+    s.p50 = pct(0.50);
+    s.p90 = pct(0.90);
+    s.p99 = pct(0.99);
+    s.max = v.back();
+    return s;
+}
+
+void writeSummary(std::FILE *f, const char *indent, const char *name, const Summary &s, bool last)
+{
+    std::fprintf(f, "%s\"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n", indent, name, s.mean,
+                 s.p50, s.p90, s.p99, s.max, last ? "" : ",");
+}
+
+std::string jsonString(const char *s)
+{
+    std::string out = "\"";
+    for (; s && *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            out += '\\';
+        if ((unsigned char)*s >= 0x20)
+            out += *s;
+    }
+    return out + "\"";
+}
+} // namespace
+
+bool parseBenchArgs(int argc, char **argv, BenchOptions &out)
+{
+    bool bench = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--bench")
+            bench = true;
+        else if (arg == "--level" && value)
+            out.levelPath = argv[++i];
+        else if (arg == "--env" && value)
+            out.envPath = argv[++i];
+        else if (arg == "--frames" && value)
+            out.frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--size" && value && std::sscanf(argv[++i], "%dx%d", &out.width, &out.height) == 2)
+            ;
+        else if (arg == "--out" && value)
+            out.outPath = argv[++i];
+        else if (arg == "--trace" && value)
+            out.tracePath = argv[++i];
+        else
+            std::fprintf(stderr, "Ignoring argument %s\n", arg.c_str());
+    }
+    out.width = std::max(out.width, 1);
+    out.height = std::max(out.height, 1);
+    return bench;
+}
+
+int runBench(const BenchOptions &opt)
+{
+    PROFILE_THREAD("main");
+    GLFWwindow *window = createContext(opt.width, opt.height);
+    if (!window)
+    {
+        std::fprintf(stderr, "Bench: no OpenGL 3.3 context\n");
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    if (!gladLoadGL(glfwGetProcAddress))
+    {
+        std::fprintf(stderr, "Failed to initialize GLAD\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return 1;
+    }
+
+    int rc = 0;
+    {
+        // Offscreen target; sRGB like the window's default framebuffer
+        GLuint fbo = 0, rb[2] = {};
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(2, rb);
+        glBindRenderbuffer(GL_RENDERBUFFER, rb[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, opt.width, opt.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, rb[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, opt.width, opt.height);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rb[1]);
+        const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        Renderer renderer;
+        EnvironmentMap env;
+        Level level;
+        VoxelWorld vox;
+        GpuPassTimer timer;
+        if (!complete || !renderer.init())
+        {
+            std::fprintf(stderr, "Bench: renderer init failed\n");
+            rc = 1;
+        }
+        else
+        {
+            glState().invalidate(); // the FBO setup above bypassed the tracker
+            renderer.setOutputFramebuffer(fbo);
+            renderer.setViewportSize(opt.width, opt.height);
+            renderer.setLightDir(glm::normalize(glm::vec3(-0.3f, -1.0f, -0.2f)));
+            if (env.loadEXR(opt.envPath))
+            {
+                renderer.setEnvironment(&env);
+                renderer.enableSky(true);
+            }
+            else
+            {
+                std::fprintf(stderr, "Bench: could not load %s, no environment\n", opt.envPath.c_str());
+            }
+            if (!level.loadFromIni(opt.levelPath))
+                std::fprintf(stderr, "Bench: could not load %s, empty level\n", opt.levelPath.c_str());
+            vox.buildFromLevel(level);
+
+            // Scripted camera: one turn around the level centre at standing eye
+            // height, looking across it, so every frame sees a different mix of
+            // geometry, shadow casters and sky
+            glm::vec3 lo(-8.0f), hi(8.0f);
+            if (!vox.colliders().empty())
+            {
+                lo = hi = vox.colliders()[0].min;
+                for (const AABB &b : vox.colliders())
+                {
+                    lo = glm::min(lo, b.min);
+                    hi = glm::max(hi, b.max);
+                }
+            }
+            const glm::vec3 center = (lo + hi) * 0.5f;
+            const float radius = 0.35f * std::max(hi.x - lo.x, hi.z - lo.z);
+            const glm::mat4 proj = glm::perspective(glm::radians(90.0f), (float)opt.width / (float)opt.height, 0.1f, 200.0f);
+            auto renderFrame = [&](int frame, int frameCount) {
+                PROFILE_SCOPE("frame");
+                float a = 6.2831853f * (float)frame / (float)frameCount;
+                glm::vec3 eye(center.x + radius * std::cos(a), lo.y + 3.0f, center.z + radius * std::sin(a));
+                glm::vec3 target(center.x - radius * std::cos(a), lo.y + 2.0f, center.z - radius * std::sin(a));
+                renderer.setCamera(proj, glm::lookAt(eye, target, glm::vec3(0, 1, 0)), eye);
+                textureStreamer().update();
+                renderer.beginFrame();
+                renderer.submitVoxels(vox, 0.75f, 1.0f);
+                renderer.endFrame();
+                glState().endFrame();
+            };
+
+            for (int i = 0; i < kWarmupFrames || (textureStreamer().pending() > 0 && i < kMaxStreamingFrames); ++i)
+                renderFrame(i, opt.frames);
+            glFinish();
+
+            using Clock = std::chrono::steady_clock;
+            std::vector<double> cpuMs, wallMs;
+            renderer.setPassTimer(&timer);
+            Clock::time_point last = Clock::now();
+            for (int i = 0; i < opt.frames; ++i)
+            {
+                const Clock::time_point start = Clock::now();
+                timer.beginFrame();
+                renderFrame(i, opt.frames);
+                const Clock::time_point end = Clock::now();
+                cpuMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                // throttled by the timer's readback once the GPU falls kFramesInFlight behind
+                wallMs.push_back(std::chrono::duration<double, std::milli>(end - last).count());
+                last = end;
+            }
+            timer.finish();
+            renderer.setPassTimer(nullptr);
+            profiler().shutdownGpu();
+            if (!opt.tracePath.empty())
+                profiler().writeChromeTrace(opt.tracePath);
+
+            std::FILE *f = std::fopen(opt.outPath.c_str(), "w");
+            if (!f)
+            {
+                std::fprintf(stderr, "Bench: cannot write %s\n", opt.outPath.c_str());
+                rc = 1;
+            }
+            else
+            {
+                std::fprintf(f, "{\n");
+                std::fprintf(f, "  \"level\": %s,\n", jsonString(opt.levelPath.c_str()).c_str());
+                std::fprintf(f, "  \"environment\": %s,\n", jsonString(opt.envPath.c_str()).c_str());
+                std::fprintf(f, "  \"renderer\": %s,\n", jsonString(reinterpret_cast<const char *>(glGetString(GL_RENDERER))).c_str());
+                std::fprintf(f, "  \"gl_version\": %s,\n", jsonString(reinterpret_cast<const char *>(glGetString(GL_VERSION))).c_str());
+                std::fprintf(f, "  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n", opt.width, opt.height, opt.frames);
+                writeSummary(f, "  ", "cpu_frame_ms", summarize(cpuMs), false);
+                writeSummary(f, "  ", "wall_frame_ms", summarize(wallMs), false);
+                std::fprintf(f, "  \"gpu_pass_ms\": {\n");
+                const auto &passes = timer.results();
+                size_t n = 0;
+                for (const auto &p : passes)
+                    writeSummary(f, "    ", p.first.c_str(), summarize(p.second), ++n == passes.size());
+                std::fprintf(f, "  }\n}\n");
+                std::fclose(f);
+                std::fprintf(stderr, "Bench: %d frames at %dx%d -> %s\n", opt.frames, opt.width, opt.height, opt.outPath.c_str());
+            }
+        }
+        textureStreamer().shutdown();
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(2, rb);
+    } // GL objects above are released while the context is still current
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return rc;
+}
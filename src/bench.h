@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+
+// Headless benchmark: render a level offscreen along a scripted camera path and
+// report CPU frame times and per-pass GPU times as JSON.
+//   qoom --bench [--level levels/level.ini] [--env assets/studio.exr]
+//                [--frames 600] [--size 1280x720] [--out bench.json]
+//                [--trace trace.json]
+// --trace also applies without --bench: a profiler trace is written at exit.
+struct BenchOptions
+{
+    std::string levelPath = "levels/level.ini";
+    std::string envPath = "assets/studio.exr";
+    int frames = 600;
+    int width = 1280, height = 720;
+    std::string outPath = "bench.json";
+    std::string tracePath; // Chrome trace of the run; empty for none
+};
+
+// True if --bench was given; the other flags fill `out`
+bool parseBenchArgs(int argc, char **argv, BenchOptions &out);
+// Process exit code
+int runBench(const BenchOptions &options);
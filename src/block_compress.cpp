@@ -0,0 +1,249 @@
+#include "block_compress.h"
+#include <algorithm>
+#include <cmath>
+
+namespace BlockCompress
+{
+
+namespace
+{
+uint16_t pack565(const float c[3])
+{
+    auto q = [](float v, int maxv) { return (uint16_t)std::min(std::max((int)std::lround(v * maxv / 255.0f), 0), maxv); };
+    return (uint16_t)(q(c[0], 31) << 11 | q(c[1], 63) << 5 | q(c[2], 31));
+}
+
+void unpack565(uint16_t v, int out[3])
+{
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    out[0] = r << 3 | r >> 2;
+    out[1] = g << 2 | g >> 4;
+    out[2] = b << 3 | b >> 2;
+}
+
+// Best 2-bit index per texel for fixed endpoints in four-colour mode; returns squared error
+uint32_t fitColorIndices(const uint8_t rgba[64], uint16_t c0, uint16_t c1, uint32_t &indices)
+{
+    int p[4][3];
+    unpack565(c0, p[0]);
+    unpack565(c1, p[1]);
+    for (int c = 0; c < 3; ++c)
+    {
+        p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+        p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+    }
+    indices = 0;
+    uint32_t error = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        const uint8_t *t = rgba + 4 * i;
+        uint32_t best = ~0u, bestIndex = 0;
+        for (uint32_t k = 0; k < 4; ++k)
+        {
+            int dr = t[0] - p[k][0], dg = t[1] - p[k][1], db = t[2] - p[k][2];
+            uint32_t d = (uint32_t)(dr * dr + dg * dg + db * db);
+            if (d < best)
+            {
+                best = d;
+                bestIndex = k;
+            }
+        }
+        indices |= bestIndex << (2 * i);
+        error += best;
+    }
+    return error;
+}
+
+// Order the endpoints for four-colour mode (c0 > c1); equal endpoints make a flat block
+uint32_t finishColorBlock(const uint8_t rgba[64], uint16_t &c0, uint16_t &c1, uint32_t &indices)
+{
+    if (c0 < c1)
+        std::swap(c0, c1);
+    if (c0 == c1)
+    {
+        indices = 0;
+        int p[3];
+        unpack565(c0, p);
+        uint32_t error = 0;
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                error += (uint32_t)((rgba[4 * i + c] - p[c]) * (rgba[4 * i + c] - p[c]));
+        return error;
+    }
+    return fitColorIndices(rgba, c0, c1, indices);
+}
+
+void writeColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, uint8_t out[8])
+{
+    out[0] = (uint8_t)c0;
+    out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)c1;
+    out[3] = (uint8_t)(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = (uint8_t)(indices >> (8 * i));
+}
+} // namespace
+
+void encodeBC1(const uint8_t rgba[64], uint8_t out[8])
+{
+    // Principal axis of the texel colours (power iteration on the covariance)
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += rgba[4 * i + c] / 16.0f;
+    float cov[6] = {0, 0, 0, 0, 0, 0}; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; ++i)
+    {
+        float d[3] = {rgba[4 * i] - mean[0], rgba[4 * i + 1] - mean[1], rgba[4 * i + 2] - mean[2]};
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+    float axis[3] = {1, 1, 1};
+    for (int iter = 0; iter < 8; ++iter)
+    {
+        float a[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2], cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                      cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        float len = std::max(std::fabs(a[0]), std::max(std::fabs(a[1]), std::fabs(a[2])));
+        if (len < 1e-6f)
+            break; // flat block: any axis works
+        for (int c = 0; c < 3; ++c)
+            axis[c] = a[c] / len;
+    }
+    float tMin = 1e30f, tMax = -1e30f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < 3; ++c)
+            t += (rgba[4 * i + c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    // Inset the extremes by half an interpolation step; the outliers still round to them
+    const float inset = (tMax - tMin) / 16.0f;
+    float hi[3], lo[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        hi[c] = mean[c] + axis[c] * (tMax - inset);
+        lo[c] = mean[c] + axis[c] * (tMin + inset);
+    }
+    uint16_t c0 = pack565(hi), c1 = pack565(lo);
+    uint32_t indices = 0;
+    uint32_t error = finishColorBlock(rgba, c0, c1, indices);
+
+    // Least-squares endpoint refinement for the chosen indices
+    static const float kWeight[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    for (int iter = 0; iter < 2 && error > 0 && c0 != c1; ++iter)
+    {
+        float aa = 0, ab = 0, bb = 0, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+        for (int i = 0; i < 16; ++i)
+        {
+            float a = kWeight[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < 3; ++c)
+            {
+                ax[c] += a * rgba[4 * i + c];
+                bx[c] += b * rgba[4 * i + c];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (std::fabs(det) < 1e-6f)
+            break;
+        for (int c = 0; c < 3; ++c)
+        {
+            hi[c] = (ax[c] * bb - bx[c] * ab) / det;
+            lo[c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+        uint16_t n0 = pack565(hi), n1 = pack565(lo);
+        uint32_t nIndices = 0;
+        uint32_t nError = finishColorBlock(rgba, n0, n1, nIndices);
+        if (nError >= error)
+            break;
+        c0 = n0;
+        c1 = n1;
+        indices = nIndices;
+        error = nError;
+    }
+    writeColorBlock(c0, c1, indices, out);
+}
+
+void encodeBC4(const uint8_t *values, size_t stride, uint8_t out[8])
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        lo = std::min(lo, (int)values[i * stride]);
+        hi = std::max(hi, (int)values[i * stride]);
+    }
+    // e0 > e1 selects the eight-value ramp; equal endpoints decode index 0 to e0
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    int ramp[8] = {hi, lo};
+    for (int k = 2; k < 8; ++k)
+        ramp[k] = ((8 - k) * hi + (k - 1) * lo) / 7;
+    uint64_t bits = 0;
+    if (hi != lo)
+        for (int i = 0; i < 16; ++i)
+        {
+            int v = values[i * stride], best = 256;
+            uint64_t bestIndex = 0;
+            for (int k = 0; k < 8; ++k)
+            {
+                int d = std::abs(v - ramp[k]);
+                if (d < best)
+                {
+                    best = d;
+                    bestIndex = (uint64_t)k;
+                }
+            }
+            bits |= bestIndex << (3 * i);
+        }
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (uint8_t)(bits >> (8 * i));
+}
+
+void encodeBC3(const uint8_t rgba[64], uint8_t out[16])
+{
+    encodeBC4(rgba + 3, 4, out);
+    encodeBC1(rgba, out + 8); // BC3 colour blocks always decode in four-colour mode
+}
+
+void encodeBC5(const uint8_t rgba[64], uint8_t out[16])
+{
+    encodeBC4(rgba, 4, out);
+    encodeBC4(rgba + 1, 4, out + 8);
+}
+
+std::vector<uint8_t> compressImage(Format f, const uint8_t *pixels, int width, int height, int channels)
+{
+    const int bw = (width + 3) / 4, bh = (height + 3) / 4;
+    const size_t bytes = blockBytes(f);
+    std::vector<uint8_t> out((size_t)bw * bh * bytes);
+    uint8_t block[64];
+    for (int by = 0; by < bh; ++by)
+        for (int bx = 0; bx < bw; ++bx)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                int x = std::min(bx * 4 + (i & 3), width - 1), y = std::min(by * 4 + (i >> 2), height - 1);
+                const uint8_t *src = pixels + ((size_t)y * width + x) * channels;
+                for (int c = 0; c < 4; ++c)
+                    block[4 * i + c] = c < channels ? src[c] : (c == 3 ? 255 : 0);
+            }
+            uint8_t *dst = &out[((size_t)by * bw + bx) * bytes];
+            switch (f)
+            {
+            case Format::BC1: encodeBC1(block, dst); break;
+            case Format::BC3: encodeBC3(block, dst); break;
+            case Format::BC4: encodeBC4(block, 4, dst); break;
+            case Format::BC5: encodeBC5(block, dst); break;
+            }
+        }
+    return out;
+}
+} // namespace BlockCompress
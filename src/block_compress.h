@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU encoders for the 4x4 block formats the renderer samples directly:
+// BC1/BC3 (S3TC/DXT1/DXT5) for colour and BC4/BC5 (RGTC1/RGTC2) for one and
+// two linear channels. Run once at cook time; quality over speed, but no
+// exhaustive search.
+namespace BlockCompress
+{
+enum class Format
+{
+    BC1, // RGB, 4 bpp
+    BC3, // RGB + interpolated alpha, 8 bpp
+    BC4, // R, 4 bpp
+    BC5, // RG, 8 bpp
+};
+
+inline size_t blockBytes(Format f) { return f == Format::BC1 || f == Format::BC4 ? 8 : 16; }
+
+// `rgba` is 16 texels in row order, 4 bytes each
+void encodeBC1(const uint8_t rgba[64], uint8_t out[8]);
+void encodeBC3(const uint8_t rgba[64], uint8_t out[16]);
+// `values` is 16 texels of one channel; `stride` bytes apart
+void encodeBC4(const uint8_t *values, size_t stride, uint8_t out[8]);
+void encodeBC5(const uint8_t rgba[64], uint8_t out[16]);
+
+// Whole image of 8-bit texels with `channels` (1..4) per texel. Partial blocks
+// at the right/bottom edge repeat the last column/row.
+std::vector<uint8_t> compressImage(Format f, const uint8_t *pixels, int width, int height, int channels);
+} // namespace BlockCompress
@@ -0,0 +1,104 @@
+#include "collision_grid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Keep the grid at most ~this many cells per box so empty space stays cheap
+static const float kMaxCellsPerBox = 4.0f;
+
+void CollisionGrid::clear(){
+    boxes_.clear();
+    cellStart_.clear();
+    cellItems_.clear();
+    stamp_.clear();
+    dims_ = glm::ivec3(0);
+}
+
+glm::ivec3 CollisionGrid::cellOf(const glm::vec3& p) const{
+    glm::ivec3 c;
+    for (int a = 0; a < 3; ++a)
+        c[a] = std::min(std::max((int)std::floor((p[a] - origin_[a]) / cellSize_), 0), dims_[a] - 1);
+    return c;
+}
+
+void CollisionGrid::build(const std::vector<AABB>& boxes){
+    clear();
+    boxes_ = boxes;
+    stamp_.assign(boxes_.size(), 0);
+    queryId_ = 0;
+    if (boxes_.empty()) return;
+
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    std::vector<float> sizes;
+    sizes.reserve(boxes_.size());
+    for (const auto& b : boxes_){
+        lo = glm::min(lo, b.min);
+        hi = glm::max(hi, b.max);
+        glm::vec3 e = b.max - b.min;
+        sizes.push_back(std::max(e.x, std::max(e.y, e.z)));
+    }
+
+    // Cell edge ~ median box size, so a typical box lands in a handful of cells;
+    // grown if the bounds would need too many cells for the box count
+    std::nth_element(sizes.begin(), sizes.begin() + sizes.size() / 2, sizes.end());
+    cellSize_ = std::max(sizes[sizes.size() / 2], 0.25f);
+    glm::vec3 ext = glm::max(hi - lo, glm::vec3(1e-3f));
+    const double maxCells = std::max(64.0, (double)boxes_.size() * kMaxCellsPerBox);
+    while ((double)std::ceil(ext.x / cellSize_) * std::ceil(ext.y / cellSize_) * std::ceil(ext.z / cellSize_) > maxCells)
+        cellSize_ *= 1.5f;
+    origin_ = lo;
+    for (int a = 0; a < 3; ++a)
+        dims_[a] = std::max(1, (int)std::ceil(ext[a] / cellSize_));
+
+    // Two passes: count per cell, then scatter into the flat item array
+    const size_t cellCount = (size_t)dims_.x * dims_.y * dims_.z;
+    cellStart_.assign(cellCount + 1, 0);
+    auto forCells = [&](const AABB& b, auto&& fn){
+        glm::ivec3 c0 = cellOf(b.min), c1 = cellOf(b.max);
+        for (int z = c0.z; z <= c1.z; ++z)
+            for (int y = c0.y; y <= c1.y; ++y)
+                for (int x = c0.x; x <= c1.x; ++x)
+                    fn(((size_t)z * dims_.y + y) * dims_.x + x);
+    };
+    for (const auto& b : boxes_)
+        forCells(b, [&](size_t c){ ++cellStart_[c + 1]; });
+    for (size_t c = 0; c < cellCount; ++c)
+        cellStart_[c + 1] += cellStart_[c];
+    cellItems_.resize(cellStart_[cellCount]);
+    std::vector<uint32_t> fill(cellStart_.begin(), cellStart_.end() - 1);
+    for (uint32_t i = 0; i < (uint32_t)boxes_.size(); ++i)
+        forCells(boxes_[i], [&](size_t c){ cellItems_[fill[c]++] = i; });
+
+    std::fprintf(stderr, "CollisionGrid: %zu boxes, %dx%dx%d cells of %.2fm, %zu refs\n",
+                 boxes_.size(), dims_.x, dims_.y, dims_.z, cellSize_, cellItems_.size());
+}
+
+void CollisionGrid::query(const AABB& box, std::vector<uint32_t>& out) const{
+    out.clear();
+    if (boxes_.empty()) return;
+    for (int a = 0; a < 3; ++a)
+        if (box.max[a] < origin_[a] || box.min[a] > origin_[a] + dims_[a] * cellSize_) return;
+
+    if (++queryId_ == 0){ // wrapped: old stamps could alias
+        std::fill(stamp_.begin(), stamp_.end(), 0);
+        queryId_ = 1;
+    }
+    glm::ivec3 c0 = cellOf(box.min), c1 = cellOf(box.max);
+    for (int z = c0.z; z <= c1.z; ++z)
+        for (int y = c0.y; y <= c1.y; ++y)
+            for (int x = c0.x; x <= c1.x; ++x){
+                size_t c = ((size_t)z * dims_.y + y) * dims_.x + x;
+                for (uint32_t k = cellStart_[c]; k < cellStart_[c + 1]; ++k){
+                    uint32_t i = cellItems_[k];
+                    if (stamp_[i] == queryId_) continue;
+                    stamp_[i] = queryId_;
+                    const AABB& b = boxes_[i];
+                    if (b.min.x <= box.max.x && b.max.x >= box.min.x &&
+                        b.min.y <= box.max.y && b.max.y >= box.min.y &&
+                        b.min.z <= box.max.z && b.max.z >= box.min.z)
+                        out.push_back(i);
+                }
+            }
+    // Keep the narrow phase resolving in level order, as the plain list did
+    std::sort(out.begin(), out.end());
+}
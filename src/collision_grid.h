@@ -0,0 +1,34 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "controller.h" // for AABB
+
+// Static broadphase over the level colliders: a uniform grid whose cells hold
+// the indices of every box that touches them (stored as one flat array with
+// per-cell offsets). Built once after the level loads.
+class CollisionGrid {
+public:
+    void build(const std::vector<AABB>& boxes);
+    void clear();
+
+    // Indices of boxes overlapping `box`, ascending (the order boxes were given in)
+    void query(const AABB& box, std::vector<uint32_t>& out) const;
+
+    const std::vector<AABB>& boxes() const { return boxes_; }
+    const AABB& box(uint32_t i) const { return boxes_[i]; }
+    size_t size() const { return boxes_.size(); }
+
+private:
+    glm::ivec3 cellOf(const glm::vec3& p) const;
+
+    std::vector<AABB> boxes_;
+    glm::vec3 origin_{0.0f};
+    float cellSize_ = 1.0f;
+    glm::ivec3 dims_{0, 0, 0};
+    std::vector<uint32_t> cellStart_; // dims.x*dims.y*dims.z + 1 offsets into cellItems_
+    std::vector<uint32_t> cellItems_;
+    // Per-box stamp so a box spanning several cells is reported once per query
+    mutable std::vector<uint32_t> stamp_;
+    mutable uint32_t queryId_ = 0;
+};
@@ -1,4 +1,5 @@
 #include "controller.h"
+#include "collision_grid.h"
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
@@ -58,14 +59,17 @@ bool QuakeController::aabbOverlap(const AABB& a, const AABB& b) const{
            (a.min.z <= b.max.z && a.max.z >= b.min.z);
 }
 
-void QuakeController::resolveCollisions(glm::vec3& pos, AABB& aabb, const std::vector<AABB>& world){
+void QuakeController::resolveCollisions(glm::vec3& pos, AABB& aabb, const CollisionGrid& world, const AABB& swept){
     // Simple axis-separated resolution (swept per axis)
     // Update AABB to new pos
     aabb.min = pos - halfExtents;
     aabb.max = pos + halfExtents;
     grounded_ = false;
 
-    for (const auto& w : world){
+    // Broadphase: only boxes near the swept player box reach the narrow phase
+    world.query(swept, candidates_);
+    for (uint32_t i : candidates_){
+        const AABB& w = world.box(i);
         if (!aabbOverlap(aabb, w)) continue;
         // Compute overlap on each axis
         float ox1 = w.max.x - aabb.min.x; // push +X
@@ -93,12 +97,19 @@ void QuakeController::resolveCollisions(glm::vec3& pos, AABB& aabb, const std::v
     }
 }
 
+void QuakeController::interpolate(float alpha){
+    renderPosition_ = glm::mix(prevPosition_, position_, clampf(alpha, 0.0f, 1.0f));
+}
+
 glm::mat4 QuakeController::view() const{
+    // Look direction is per-frame mouse input, only the position is stepped
     glm::vec3 f = forward();
-    return glm::lookAt(position_, position_ + f, glm::vec3(0,1,0));
+    return glm::lookAt(renderPosition_, renderPosition_ + f, glm::vec3(0,1,0));
 }
 
-void QuakeController::update(GLFWwindow* window, float dt, const std::vector<AABB>& world){
+void QuakeController::update(GLFWwindow* window, float dt, const CollisionGrid& world){
+    prevPosition_ = position_;
+
     // Inputs
     bool up = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
     bool down = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
@@ -137,6 +148,9 @@ void QuakeController::update(GLFWwindow* window, float dt, const std::vector<AAB
     // Integrate and collide
     glm::vec3 newPos = position_ + velocity_ * dt;
     AABB me{newPos - halfExtents, newPos + halfExtents};
-    resolveCollisions(newPos, me, world);
+    // Old and new boxes, padded by a half extent since a push-out can move the
+    // player a little past where it started
+    AABB swept{glm::min(position_, newPos) - halfExtents * 2.0f, glm::max(position_, newPos) + halfExtents * 2.0f};
+    resolveCollisions(newPos, me, world, swept);
     position_ = newPos;
 }
@@ -1,7 +1,9 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <vector>
 struct GLFWwindow;
+class CollisionGrid;
 
 struct AABB { glm::vec3 min, max; };
 
@@ -9,19 +11,25 @@ class Controller {
 public:
     virtual ~Controller() = default;
     virtual void handleMouse(GLFWwindow* window, double xpos, double ypos) = 0;
-    virtual void update(GLFWwindow* window, float dt, const std::vector<AABB>& world) = 0;
-    virtual glm::mat4 view() const = 0;
-    virtual glm::vec3 position() const = 0;
+    // Advances the simulation by one fixed step
+    virtual void update(GLFWwindow* window, float dt, const CollisionGrid& world) = 0;
+    // Blend factor between the previous and current step for the rendered camera
+    virtual void interpolate(float alpha) = 0;
+    virtual glm::mat4 view() const = 0;     // interpolated camera
+    virtual glm::vec3 eyePosition() const = 0; // interpolated camera position
+    virtual glm::vec3 position() const = 0; // simulated position
 };
 
 class QuakeController : public Controller {
 public:
     QuakeController();
     void handleMouse(GLFWwindow* window, double xpos, double ypos) override;
-    void update(GLFWwindow* window, float dt, const std::vector<AABB>& world) override;
+    void update(GLFWwindow* window, float dt, const CollisionGrid& world) override;
+    void interpolate(float alpha) override;
     glm::mat4 view() const override;
+    glm::vec3 eyePosition() const override { return renderPosition_; }
     glm::vec3 position() const override { return position_; }
-    void setPosition(const glm::vec3& p) { position_ = p; }
+    void setPosition(const glm::vec3& p) { position_ = prevPosition_ = renderPosition_ = p; }
 
     // Config
     float fovDeg = 90.f;
@@ -35,18 +43,21 @@ private:
     void accelerate(const glm::vec3& wishdir, float wishspeed, float accel, float dt);
     void applyFriction(float dt);
     bool aabbOverlap(const AABB& a, const AABB& b) const;
-    void resolveCollisions(glm::vec3& pos, AABB& aabb, const std::vector<AABB>& world);
+    void resolveCollisions(glm::vec3& pos, AABB& aabb, const CollisionGrid& world, const AABB& swept);
 
     glm::vec3 forward() const;
     glm::vec3 right() const;
 
     // State
     glm::vec3 position_{0.f, 1.0f, 3.0f};
+    glm::vec3 prevPosition_{0.f, 1.0f, 3.0f};   // position before the last step
+    glm::vec3 renderPosition_{0.f, 1.0f, 3.0f}; // blend of the two for drawing
     glm::vec3 velocity_{0.f};
     float yaw_ = -90.f;  // degrees
     float pitch_ = 0.f;  // degrees
     bool firstMouse_ = true; double lastX_ = 0.0, lastY_ = 0.0;
     bool grounded_ = false;
+    std::vector<uint32_t> candidates_; // broadphase results, reused each frame
 
     // Tuning (approx Quake-like)
     float moveSpeed_ = 6.0f;       // target ground speed m/s
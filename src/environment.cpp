@@ -1,27 +1,535 @@
 #include "environment.h"
+#include "model_cache.h"
+#include "profiler.h"
+#include "vertex_format.h"
+#include <glm/glm.hpp>
 #include <tinyexr.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
 #include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define QOOM_ENV_SSE2 1
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define QOOM_ENV_F16C 1 // compiled for F16C regardless of -march, used if the CPU has it
+#endif
 
-EnvironmentMap::~EnvironmentMap(){
-    if (tex_) glDeleteTextures(1, &tex_);
+// Sidecar layout: header, then each specular level as six RGBA16F cube faces
+// (level 0 first, faces in GL order), then the BRDF LUT as RG16F. Everything is
+// rebuilt when the EXR changes.
+namespace {
+constexpr char kMagic[4] = {'Q', 'I', 'B', '1'};
+constexpr uint32_t kVersion = 3;
+constexpr int kMaxSpecularLevels = 6; // roughness 0, 0.2, ..., 1
+constexpr int kPrefilterSamples = 64;
+constexpr int kLutSize = 64;
+constexpr int kLutSamples = 512;
+constexpr float kPi = 3.14159265f;
+
+struct IblHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash, sourceSize;
+    int64_t sourceMtime;
+    uint32_t faceSize, levels, lutSize, pad;
+    float sh[9][4];
+    uint64_t fileBytes;
+};
+static_assert(sizeof(IblHeader) == 200, "IBL header is written as raw bytes");
+
+int levelSize(int size, int level) { return std::max(1, size >> level); }
+
+uint64_t expectedBytes(const IblHeader& h){
+    uint64_t bytes = sizeof(IblHeader);
+    for (uint32_t l = 0; l < h.levels; ++l)
+        bytes += 6 * (uint64_t)levelSize((int)h.faceSize, (int)l) * levelSize((int)h.faceSize, (int)l) * 4 * sizeof(uint16_t);
+    return bytes + (uint64_t)h.lutSize * h.lutSize * 2 * sizeof(uint16_t);
 }
 
-bool EnvironmentMap::loadEXR(const std::string& path){
-    if (tex_) { glDeleteTextures(1, &tex_); tex_ = 0; }
-    float* out = nullptr; int w = 0, h = 0; const char* err = nullptr;
-    int ret = LoadEXR(&out, &w, &h, path.c_str(), &err);
-    if (ret != TINYEXR_SUCCESS) {
+// fn(row) for rows [0, n), spread over every core
+void parallelRows(int n, const std::function<void(int)>& fn){
+    std::atomic<int> next{0};
+    auto work = [&]{
+        PROFILE_SCOPE("parallelRows");
+        for (int i; (i = next++) < n;) fn(i);
+    };
+    std::vector<std::thread> threads;
+    const int threadCount = std::min(n, (int)std::max(1u, std::thread::hardware_concurrency()));
+    for (int t = 1; t < threadCount; ++t) threads.emplace_back(work);
+    work();
+    for (auto& t : threads) t.join();
+}
+
+// Same mapping as dirToEquirect in the shaders: +Y up, u = 0.5 along +X
+glm::vec3 equirectToDir(float u, float v){
+    float phi = (u - 0.5f) * 2.0f * kPi, theta = v * kPi;
+    return {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+}
+
+// theta from atan2 rather than acos, so `d` need not be normalised
+glm::vec2 dirToEquirect(const glm::vec3& d){
+    float phi = std::atan2(d.z, d.x), theta = std::atan2(std::sqrt(d.x * d.x + d.z * d.z), d.y);
+    return {phi / (2.0f * kPi) + 0.5f, theta / kPi};
+}
+
+#ifdef QOOM_ENV_SSE2
+// atan2 for four lanes: octant reduction plus a degree-11 odd minimax polynomial
+// (|error| < 1e-5 rad, far below a source texel)
+__m128 atan2x4(__m128 y, __m128 x){
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y);
+    __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(-0.01172120f);
+    for (float c : {0.05265332f, -0.11643287f, 0.19354346f, -0.33262347f, 0.99997726f})
+        r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(c));
+    r = _mm_mul_ps(r, a);
+    auto select = [](__m128 mask, __m128 t, __m128 f){ return _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, f)); };
+    r = select(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(0.5f * kPi), r), r);
+    r = select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(kPi), r), r);
+    return _mm_or_ps(r, _mm_and_ps(sign, y));
+}
+#endif
+
+// dirToEquirect over arrays (directions need not be normalised)
+void dirsToEquirect(const float* dx, const float* dy, const float* dz, float* u, float* v, int n){
+    int i = 0;
+#ifdef QOOM_ENV_SSE2
+    const __m128 uScale = _mm_set1_ps(1.0f / (2.0f * kPi)), vScale = _mm_set1_ps(1.0f / kPi), half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= n; i += 4){
+        __m128 x = _mm_loadu_ps(dx + i), y = _mm_loadu_ps(dy + i), z = _mm_loadu_ps(dz + i);
+        __m128 horizontal = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)));
+        _mm_storeu_ps(u + i, _mm_add_ps(_mm_mul_ps(atan2x4(z, x), uScale), half));
+        _mm_storeu_ps(v + i, _mm_mul_ps(atan2x4(horizontal, y), vScale));
+    }
+#endif
+    for (; i < n; ++i){
+        glm::vec2 uv = dirToEquirect(glm::vec3(dx[i], dy[i], dz[i]));
+        u[i] = uv.x;
+        v[i] = uv.y;
+    }
+}
+
+// Unnormalised direction through texel (x, y) of a cube face, GL face order and orientation
+glm::vec3 cubeFaceDir(int face, int x, int y, int size){
+    float s = 2.0f * (x + 0.5f) / size - 1.0f, t = 2.0f * (y + 0.5f) / size - 1.0f;
+    switch (face){
+    case 0: return {1.0f, -t, -s};
+    case 1: return {-1.0f, -t, s};
+    case 2: return {s, 1.0f, t};
+    case 3: return {s, -1.0f, -t};
+    case 4: return {s, -t, 1.0f};
+    default: return {-s, -t, -1.0f};
+    }
+}
+
+#ifdef QOOM_ENV_F16C
+__attribute__((target("f16c"))) void storeHalfRowF16C(const glm::vec3* rgb, int n, uint16_t* dst){
+    for (int i = 0; i < n; ++i){
+        __m128 c = _mm_setr_ps(rgb[i].x, rgb[i].y, rgb[i].z, 1.0f);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 4 * i), _mm_cvtps_ph(c, _MM_FROUND_TO_NEAREST_INT));
+    }
+}
+#endif
+
+// n RGB texels to RGBA16F with alpha 1
+void storeHalfRow(const glm::vec3* rgb, int n, uint16_t* dst){
+#ifdef QOOM_ENV_F16C
+    static const bool hasF16C = __builtin_cpu_supports("f16c");
+    if (hasF16C){
+        storeHalfRowF16C(rgb, n, dst);
+        return;
+    }
+#endif
+    for (int i = 0; i < n; ++i){
+        dst[4 * i + 0] = vertex::floatToHalf(rgb[i].x);
+        dst[4 * i + 1] = vertex::floatToHalf(rgb[i].y);
+        dst[4 * i + 2] = vertex::floatToHalf(rgb[i].z);
+        dst[4 * i + 3] = vertex::floatToHalf(1.0f);
+    }
+}
+
+// Decode an EXR already in memory to linear RGB. Scanline files read their
+// planar float channels straight from tinyexr, which decompresses blocks on
+// every core (its target is built with TINYEXR_USE_THREAD, see CMakeLists.txt);
+// tiled and multipart files take the slower all-in-one RGBA path.
+bool decodeEXR(const uint8_t* data, size_t size, std::vector<glm::vec3>& rgb, int& w, int& h){
+    PROFILE_SCOPE("decodeEXR");
+    EXRVersion version;
+    if (ParseEXRVersionFromMemory(&version, data, size) != TINYEXR_SUCCESS) return false;
+    const char* err = nullptr;
+    if (version.tiled || version.multipart || version.non_image){
+        float* rgba = nullptr;
+        if (LoadEXRFromMemory(&rgba, &w, &h, data, size, &err) != TINYEXR_SUCCESS){
+            if (err) FreeEXRErrorMessage(err);
+            return false;
+        }
+        rgb.resize((size_t)w * h);
+        for (size_t i = 0; i < rgb.size(); ++i) rgb[i] = glm::vec3(rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2]);
+        free(rgba);
+        return true;
+    }
+
+    EXRHeader header;
+    InitEXRHeader(&header);
+    if (ParseEXRHeaderFromMemory(&header, &version, data, size, &err) != TINYEXR_SUCCESS){
         if (err) FreeEXRErrorMessage(err);
         return false;
     }
+    // R/G/B, preferring unlayered names; a lone channel (luminance) feeds all three
+    int channel[3] = {-1, -1, -1};
+    for (int c = 0; c < header.num_channels; ++c){
+        header.requested_pixel_types[c] = TINYEXR_PIXELTYPE_FLOAT;
+        const char* name = header.channels[c].name;
+        const char* dot = std::strrchr(name, '.');
+        const char* base = dot ? dot + 1 : name;
+        for (int k = 0; k < 3; ++k)
+            if (std::strcmp(base, k == 0 ? "R" : k == 1 ? "G" : "B") == 0 && (channel[k] < 0 || !dot)) channel[k] = c;
+    }
+    for (int k = 0; k < 3; ++k)
+        if (channel[k] < 0) channel[k] = channel[0] >= 0 ? channel[0] : 0;
+
+    EXRImage image;
+    InitEXRImage(&image);
+    const bool ok = header.num_channels > 0 && LoadEXRImageFromMemory(&image, &header, data, size, &err) == TINYEXR_SUCCESS;
+    if (ok){
+        w = image.width;
+        h = image.height;
+        rgb.resize((size_t)w * h);
+        const float* r = reinterpret_cast<const float*>(image.images[channel[0]]);
+        const float* g = reinterpret_cast<const float*>(image.images[channel[1]]);
+        const float* b = reinterpret_cast<const float*>(image.images[channel[2]]);
+        parallelRows(h, [&](int y){
+            for (size_t i = (size_t)y * w, end = i + w; i < end; ++i) rgb[i] = glm::vec3(r[i], g[i], b[i]);
+        });
+    } else if (err) {
+        FreeEXRErrorMessage(err);
+    }
+    FreeEXRImage(&image);
+    FreeEXRHeader(&header);
+    return ok;
+}
+
+// Source image with box-filtered mips, for filtered importance sampling
+struct Pyramid {
+    struct Level { int w, h; std::vector<glm::vec3> texels; };
+    std::vector<Level> levels;
+
+    Pyramid(std::vector<glm::vec3> base, int w, int h){
+        levels.push_back({w, h, std::move(base)});
+        while (levels.back().w > 1 || levels.back().h > 1){
+            const Level& src = levels.back();
+            Level dst{std::max(1, src.w / 2), std::max(1, src.h / 2), {}};
+            dst.texels.resize((size_t)dst.w * dst.h);
+            parallelRows(dst.h, [&](int y){
+                for (int x = 0; x < dst.w; ++x){
+                    int x0 = std::min(2 * x, src.w - 1), x1 = std::min(2 * x + 1, src.w - 1);
+                    int y0 = std::min(2 * y, src.h - 1), y1 = std::min(2 * y + 1, src.h - 1);
+                    dst.texels[(size_t)y * dst.w + x] = 0.25f * (src.texels[(size_t)y0 * src.w + x0] + src.texels[(size_t)y0 * src.w + x1] +
+                                                                src.texels[(size_t)y1 * src.w + x0] + src.texels[(size_t)y1 * src.w + x1]);
+                }
+            });
+            levels.push_back(std::move(dst));
+        }
+    }
+
+    // Bilinear; u wraps, v clamps
+    glm::vec3 sample(int level, glm::vec2 uv) const {
+        const Level& l = levels[level];
+        float x = uv.x * l.w - 0.5f, y = uv.y * l.h - 0.5f;
+        int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+        float fx = x - x0, fy = y - y0;
+        auto at = [&](int px, int py){
+            px = ((px % l.w) + l.w) % l.w;
+            py = std::min(std::max(py, 0), l.h - 1);
+            return l.texels[(size_t)py * l.w + px];
+        };
+        return glm::mix(glm::mix(at(x0, y0), at(x0 + 1, y0), fx), glm::mix(at(x0, y0 + 1), at(x0 + 1, y0 + 1), fx), fy);
+    }
+
+    glm::vec3 sampleLod(glm::vec2 uv, float lod) const {
+        lod = std::min(std::max(lod, 0.0f), (float)(levels.size() - 1));
+        int l0 = (int)lod, l1 = std::min(l0 + 1, (int)levels.size() - 1);
+        return glm::mix(sample(l0, uv), sample(l1, uv), lod - l0);
+    }
+    glm::vec3 sampleLod(const glm::vec3& dir, float lod) const { return sampleLod(dirToEquirect(dir), lod); }
+};
+
+glm::vec2 hammersley(uint32_t i, uint32_t n){
+    uint32_t bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return {(float)i / (float)n, bits * 2.3283064365386963e-10f};
+}
+
+// GGX half vector around +Z for roughness^2 = a
+glm::vec3 importanceSampleGGX(glm::vec2 xi, float a){
+    float phi = 2.0f * kPi * xi.x;
+    float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+    float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+    return {sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta};
+}
+
+// Level 0: the source resampled onto the six faces, rows spread over every core
+void convertToCube(const Pyramid& src, int size, uint16_t* out){
+    // faces rounded down to a power of two read a matching source mip instead of aliasing
+    const float lod = std::max(0.0f, std::log2((float)src.levels[0].w / (4.0f * size)));
+    parallelRows(6 * size, [&](int row){
+        const int face = row / size, y = row % size;
+        std::vector<float> dx(size), dy(size), dz(size), u(size), v(size);
+        std::vector<glm::vec3> color(size);
+        for (int x = 0; x < size; ++x){
+            glm::vec3 d = cubeFaceDir(face, x, y, size);
+            dx[x] = d.x; dy[x] = d.y; dz[x] = d.z;
+        }
+        dirsToEquirect(dx.data(), dy.data(), dz.data(), u.data(), v.data(), size);
+        for (int x = 0; x < size; ++x) color[x] = src.sampleLod(glm::vec2(u[x], v[x]), lod);
+        storeHalfRow(color.data(), size, out + (size_t)row * size * 4);
+    });
+}
+
+// One specular level: radiance convolved with GGX at N = V = R (the split-sum
+// assumption), per cube face texel. Samples read a source mip matched to their
+// solid angle so few samples stay noise-free.
+void prefilterLevel(const Pyramid& src, float roughness, int size, uint16_t* out){
+    struct Sample { glm::vec3 l; float lod; };
+    const float a = roughness * roughness;
+    const float texelSolidAngle = 4.0f * kPi / (float)(src.levels[0].w * src.levels[0].h);
+    std::vector<Sample> samples;
+    for (uint32_t i = 0; i < (uint32_t)kPrefilterSamples; ++i){
+        glm::vec3 hv = importanceSampleGGX(hammersley(i, kPrefilterSamples), a);
+        glm::vec3 l = 2.0f * hv.z * hv - glm::vec3(0, 0, 1);
+        if (l.z <= 0.0f) continue;
+        float d = (hv.z * hv.z) * (a * a - 1.0f) + 1.0f;
+        float D = a * a / (kPi * d * d);
+        float pdf = D / 4.0f; // D * NdotH / (4 * VdotH) with V = N
+        float sampleSolidAngle = 1.0f / ((float)kPrefilterSamples * pdf + 1e-6f);
+        samples.push_back({l, 0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f});
+    }
+    parallelRows(6 * size, [&](int row){
+        const int face = row / size, y = row % size;
+        std::vector<glm::vec3> color(size);
+        for (int x = 0; x < size; ++x){
+            glm::vec3 n = glm::normalize(cubeFaceDir(face, x, y, size));
+            glm::vec3 up = std::fabs(n.y) < 0.999f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+            glm::vec3 t = glm::normalize(glm::cross(up, n)), b = glm::cross(n, t);
+            glm::vec3 sum(0.0f);
+            float weight = 0.0f;
+            for (const Sample& s : samples){
+                sum += src.sampleLod(t * s.l.x + b * s.l.y + n * s.l.z, s.lod) * s.l.z;
+                weight += s.l.z;
+            }
+            color[x] = weight > 0.0f ? sum / weight : glm::vec3(0.0f);
+        }
+        storeHalfRow(color.data(), size, out + (size_t)row * size * 4);
+    });
+}
+
+// Split-sum environment BRDF: (scale, bias) on F0 over (NdotV, roughness)
+void integrateBrdf(uint16_t* out){
+    parallelRows(kLutSize, [&](int y){
+        const float roughness = (y + 0.5f) / kLutSize, a = roughness * roughness, k = a / 2.0f;
+        for (int x = 0; x < kLutSize; ++x){
+            const float nv = (x + 0.5f) / kLutSize;
+            const glm::vec3 v(std::sqrt(1.0f - nv * nv), 0.0f, nv);
+            float scale = 0.0f, bias = 0.0f;
+            for (uint32_t i = 0; i < (uint32_t)kLutSamples; ++i){
+                glm::vec3 hv = importanceSampleGGX(hammersley(i, kLutSamples), a);
+                float vh = glm::dot(v, hv);
+                glm::vec3 l = 2.0f * vh * hv - v;
+                if (l.z <= 0.0f) continue;
+                float g = (nv / (nv * (1.0f - k) + k)) * (l.z / (l.z * (1.0f - k) + k));
+                float gVis = g * std::max(vh, 0.0f) / (hv.z * nv);
+                float fc = std::pow(1.0f - std::max(vh, 0.0f), 5.0f);
+                scale += (1.0f - fc) * gVis;
+                bias += fc * gVis;
+            }
+            out[((size_t)y * kLutSize + x) * 2] = vertex::floatToHalf(scale / kLutSamples);
+            out[((size_t)y * kLutSize + x) * 2 + 1] = vertex::floatToHalf(bias / kLutSamples);
+        }
+    });
+}
+
+// Project radiance onto SH9 and convolve with the clamped cosine (Ramamoorthi &
+// Hanrahan); the result is irradiance / pi in the polynomial basis the shader uses
+void projectIrradianceSH(const Pyramid& src, float out[9][4]){
+    // a level around 256 wide is plenty for the lowest nine frequencies
+    int level = 0;
+    while (level + 1 < (int)src.levels.size() && src.levels[level].w > 256) ++level;
+    const Pyramid::Level& l = src.levels[level];
+    std::vector<glm::vec3> rows((size_t)l.h * 9, glm::vec3(0.0f));
+    parallelRows(l.h, [&](int y){
+        const float v = (y + 0.5f) / l.h;
+        const float solidAngle = (2.0f * kPi / l.w) * (kPi / l.h) * std::sin(v * kPi);
+        glm::vec3* acc = &rows[(size_t)y * 9];
+        for (int x = 0; x < l.w; ++x){
+            glm::vec3 d = equirectToDir((x + 0.5f) / l.w, v);
+            glm::vec3 c = l.texels[(size_t)y * l.w + x] * solidAngle;
+            const float basis[9] = {1.0f, d.y, d.z, d.x, d.x * d.y, d.y * d.z, 3.0f * d.z * d.z - 1.0f, d.x * d.z, d.x * d.x - d.y * d.y};
+            for (int i = 0; i < 9; ++i) acc[i] += c * basis[i];
+        }
+    });
+    // per coefficient: band constant A_l times the squared basis normalisation, over pi
+    const float k[9] = {0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f};
+    const float band[9] = {kPi, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f, 2.0f * kPi / 3.0f, kPi / 4.0f, kPi / 4.0f, kPi / 4.0f, kPi / 4.0f, kPi / 4.0f};
+    for (int i = 0; i < 9; ++i){
+        glm::vec3 sum(0.0f);
+        for (int y = 0; y < l.h; ++y) sum += rows[(size_t)y * 9 + i];
+        glm::vec3 c = sum * (band[i] * k[i] * k[i] / kPi);
+        out[i][0] = c.x; out[i][1] = c.y; out[i][2] = c.z; out[i][3] = 0.0f;
+    }
+}
+} // namespace
+
+EnvironmentMap::~EnvironmentMap(){
+    release();
+}
+
+void EnvironmentMap::release(){
+    for (GLuint* t : {&tex_, &lut_})
+        if (*t) { glState().forgetTexture(*t); glDeleteTextures(1, t); *t = 0; }
+    specularLevels_ = 0;
+}
+
+bool EnvironmentMap::loadEXR(const std::string& path){
+    PROFILE_SCOPE("EnvironmentMap::loadEXR");
+    release();
+    const auto t0 = std::chrono::steady_clock::now();
+    auto elapsedMs = [&]{ return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count(); };
+    FileStamp stamp;
+    if (!statFile(path, stamp)) return false;
+    // mapped at most once: hashed when the stamp alone cannot vouch for the
+    // cache, then decoded in place on a miss
+    MappedFile source;
+    uint64_t sourceHash = 0;
+    auto hashSource = [&]{
+        if (!source.data() && !source.open(path)) return false;
+        sourceHash = hashBytes(source.data(), source.size());
+        return true;
+    };
+    const std::string cachePath = path + ".ibl";
+    {
+        MappedFile cache;
+        IblHeader cached;
+        if (cache.open(cachePath) && cache.size() >= sizeof(cached)){
+            std::memcpy(&cached, cache.data(), sizeof(cached));
+            // same stamp: trusted unread; otherwise the contents decide
+            bool current = cached.sourceSize == stamp.size && cached.sourceMtime == stamp.mtime;
+            if (!current && hashSource()) current = cached.sourceHash == sourceHash;
+            if (current && upload(cache.data(), cache.size())){
+                std::fprintf(stderr, "EnvironmentMap: %s from cache in %.1f ms\n", path.c_str(), elapsedMs());
+                return true;
+            }
+        }
+    }
+    if (!source.data() && !hashSource()) return false;
+
+    std::vector<glm::vec3> pixels;
+    int w = 0, h = 0;
+    if (!decodeEXR(source.data(), source.size(), pixels, w, h)) return false;
+    source.close();
+    const double decodeMs = elapsedMs();
+
+    IblHeader hdr{};
+    std::memcpy(hdr.magic, kMagic, 4);
+    hdr.version = kVersion;
+    hdr.sourceHash = sourceHash;
+    hdr.sourceSize = stamp.size;
+    hdr.sourceMtime = stamp.mtime;
+    // a face spans a quarter of the equirect's width; keep it a power of two
+    uint32_t faceSize = 1;
+    while (faceSize * 2 <= (uint32_t)std::max(1, w / 4)) faceSize *= 2;
+    hdr.faceSize = faceSize;
+    int fullChain = 1;
+    while ((faceSize >> fullChain) > 0) ++fullChain;
+    hdr.levels = (uint32_t)std::min(kMaxSpecularLevels, fullChain);
+    hdr.lutSize = kLutSize;
+    hdr.fileBytes = expectedBytes(hdr);
+
+    std::vector<uint8_t> file((size_t)hdr.fileBytes);
+    {
+        PROFILE_SCOPE("EnvironmentMap prefilter");
+        Pyramid src(std::move(pixels), w, h);
+        projectIrradianceSH(src, hdr.sh);
+        std::memcpy(file.data(), &hdr, sizeof(hdr));
+        uint16_t* dst = reinterpret_cast<uint16_t*>(file.data() + sizeof(hdr));
+        for (int l = 0; l < (int)hdr.levels; ++l){
+            int size = levelSize((int)faceSize, l);
+            // mirror reflection is the source itself (also what the sky draws)
+            if (l == 0) convertToCube(src, size, dst);
+            else prefilterLevel(src, (float)l / (float)(hdr.levels - 1), size, dst);
+            dst += 6 * (size_t)size * size * 4;
+        }
+        integrateBrdf(dst);
+    }
+    const double computeMs = elapsedMs();
+
+    // Write to a temporary and rename so a crash never leaves a truncated cache behind
+    const std::string tmp = cachePath + ".tmp";
+    bool written = false;
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        written = f && f.write(reinterpret_cast<const char*>(file.data()), (std::streamsize)file.size());
+    }
+    std::error_code ec;
+    if (written) std::filesystem::rename(tmp, cachePath, ec);
+    if (!written || ec){
+        std::filesystem::remove(tmp, ec);
+        std::fprintf(stderr, "EnvironmentMap: could not write %s\n", cachePath.c_str());
+    }
+    if (!upload(file.data(), file.size())) return false;
+    std::fprintf(stderr, "EnvironmentMap: %s (%dx%d) decoded in %.1f ms -> %u^2 cube, prefiltered %u levels in %.1f ms\n", path.c_str(), w,
+                 h, decodeMs, faceSize, hdr.levels, computeMs - decodeMs);
+    return true;
+}
+
+bool EnvironmentMap::upload(const uint8_t* data, size_t size){
+    PROFILE_SCOPE("EnvironmentMap::upload");
+    IblHeader hdr;
+    if (size < sizeof(hdr)) return false;
+    std::memcpy(&hdr, data, sizeof(hdr));
+    if (std::memcmp(hdr.magic, kMagic, 4) != 0 || hdr.version != kVersion) return false;
+    if (hdr.levels == 0 || hdr.levels > (uint32_t)kMaxSpecularLevels || hdr.fileBytes != size || expectedBytes(hdr) != size) return false;
+
+    const uint8_t* p = data + sizeof(hdr);
     glGenTextures(1, &tex_);
-    glBindTexture(GL_TEXTURE_2D, tex_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0, GL_RGBA, GL_FLOAT, out);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glState().bindTextureForUpdate(GL_TEXTURE_CUBE_MAP, tex_);
+    for (int l = 0; l < (int)hdr.levels; ++l){
+        int size = levelSize((int)hdr.faceSize, l);
+        for (int face = 0; face < 6; ++face){
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, l, GL_RGBA16F, size, size, 0, GL_RGBA, GL_HALF_FLOAT, p);
+            p += (size_t)size * size * 4 * sizeof(uint16_t);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, (GLint)hdr.levels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    for (GLenum wrap : {GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T, GL_TEXTURE_WRAP_R})
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, wrap, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &lut_);
+    glState().bindTextureForUpdate(GL_TEXTURE_2D, lut_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, (GLsizei)hdr.lutSize, (GLsizei)hdr.lutSize, 0, GL_RG, GL_HALF_FLOAT, p);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    free(out);
+
+    specularLevels_ = (int)hdr.levels;
+    std::memcpy(sh_, hdr.sh, sizeof(sh_));
     return true;
 }
@@ -1,7 +1,15 @@
 #pragma once
 #include <glad/gl.h>
+#include "gl_state.h"
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+// HDR environment, loaded from an equirectangular EXR and converted to a cubemap,
+// plus the image-based lighting derived from it: a GGX-prefiltered specular
+// chain in the cubemap's mips (level 0 is the source, the last level roughness
+// 1), a split-sum BRDF lookup table and SH9 irradiance. The derived data is
+// computed once on all cores and cached in <path>.ibl.
 class EnvironmentMap {
 public:
     EnvironmentMap() = default;
@@ -11,9 +19,23 @@ public:
     bool loadEXR(const std::string& path);
     GLuint id() const { return tex_; }
     void bind(GLenum unit) const {
-        glActiveTexture(unit);
-        glBindTexture(GL_TEXTURE_2D, tex_);
+        glState().bindTexture(unit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, tex_);
     }
+    void bindBrdfLut(GLenum unit) const {
+        glState().bindTexture(unit - GL_TEXTURE0, GL_TEXTURE_2D, lut_);
+    }
+    // Highest specular mip; sample at roughness * maxSpecularLod()
+    float maxSpecularLod() const { return (float)(specularLevels_ - 1); }
+    // 9 x vec4 (rgb used), already convolved with the clamped cosine and divided
+    // by pi: diffuse radiance is albedo * sum(sh[i] * basis_i(n))
+    const float* irradianceSH() const { return sh_[0]; }
+
 private:
-    GLuint tex_ = 0;
+    void release();
+    // A complete .ibl image; the caller has checked it matches the source
+    bool upload(const uint8_t* data, size_t size);
+
+    GLuint tex_ = 0, lut_ = 0;
+    int specularLevels_ = 0;
+    float sh_[9][4] = {};
 };
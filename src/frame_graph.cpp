@@ -0,0 +1,81 @@
+#include "frame_graph.h"
+#include "gl_state.h"
+#include "gpu_pass_timer.h"
+#include "profiler.h"
+
+FrameGraph::Resource FrameGraph::importTarget(const char *name, GLuint fbo, int width, int height)
+{
+    Target t;
+    t.name = name;
+    t.fbo = fbo;
+    t.width = width;
+    t.height = height;
+    targets_.push_back(t);
+    return (Resource)targets_.size() - 1;
+}
+
+void FrameGraph::markOutput(Resource r)
+{
+    targets_[r].output = true;
+}
+
+void FrameGraph::addPass(const char *name, Resource target, GLbitfield clearMask, std::vector<Resource> reads, std::function<void()> run)
+{
+    Pass p;
+    p.name = name;
+    p.target = target;
+    p.clearMask = clearMask;
+    p.reads = std::move(reads);
+    p.run = std::move(run);
+    passes_.push_back(std::move(p));
+}
+
+void FrameGraph::execute()
+{
+    // Cull back to front: a pass lives if its target is an output or is read by a later live pass
+    std::vector<char> needed(targets_.size(), 0), live(passes_.size(), 0);
+    for (size_t t = 0; t < targets_.size(); ++t)
+        needed[t] = targets_[t].output ? 1 : 0;
+    for (size_t i = passes_.size(); i-- > 0;)
+    {
+        const Pass &p = passes_[i];
+        if (!needed[p.target])
+            continue;
+        live[i] = 1;
+        for (Resource r : p.reads)
+            needed[r] = 1;
+    }
+
+    GLState &gs = glState();
+    executed_ = 0;
+    for (size_t i = 0; i < passes_.size(); ++i)
+    {
+        if (!live[i])
+            continue;
+        const Pass &p = passes_[i];
+        const Target &t = targets_[p.target];
+        PROFILE_GPU_SCOPE(p.name);
+        if (timer_)
+            timer_->begin(p.name);
+        gs.bindFramebuffer(t.fbo);
+        if (t.width > 0 && t.height > 0)
+            gs.viewport(0, 0, t.width, t.height);
+        if (p.clearMask)
+        {
+            if (p.clearMask & GL_COLOR_BUFFER_BIT)
+                glClearColor(clearColor_.r, clearColor_.g, clearColor_.b, clearColor_.a);
+            glClear(p.clearMask);
+        }
+        if (p.run)
+            p.run();
+        if (timer_)
+            timer_->end();
+        ++executed_;
+    }
+}
+
+void FrameGraph::reset()
+{
+    targets_.clear();
+    passes_.clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+class GpuPassTimer;
+
+// Per-frame pass scheduler. Render targets are declared as resources; passes
+// name the target they write, the resources they read, and a callback. On
+// execute, passes whose output nothing consumes are dropped, the rest run in
+// submission order with their target bound, its viewport set and (on the
+// pass's request) cleared. Rebuilt every frame.
+class FrameGraph
+{
+public:
+    using Resource = int;
+
+    // An existing framebuffer (0 = default) of the given size
+    Resource importTarget(const char *name, GLuint fbo, int width, int height);
+    // Final outputs keep the passes that write them (and what those read) alive
+    void markOutput(Resource r);
+
+    // `name` is kept as a pointer: pass a literal
+    void addPass(const char *name, Resource target, GLbitfield clearMask, std::vector<Resource> reads, std::function<void()> run);
+    void setClearColor(const glm::vec4 &c) { clearColor_ = c; }
+    // Optional: every executed pass (bind, clear and body) is timed under its name
+    void setTimer(GpuPassTimer *timer) { timer_ = timer; }
+
+    void execute();
+    void reset();
+
+    // Passes run by the last execute(), for diagnostics
+    size_t executedPasses() const { return executed_; }
+
+private:
+    struct Target
+    {
+        std::string name;
+        GLuint fbo = 0;
+        int width = 0, height = 0;
+        bool output = false;
+    };
+    struct Pass
+    {
+        const char *name = nullptr; // also the profiler zone name
+        Resource target = -1;
+        GLbitfield clearMask = 0;
+        std::vector<Resource> reads;
+        std::function<void()> run;
+    };
+    std::vector<Target> targets_;
+    std::vector<Pass> passes_;
+    glm::vec4 clearColor_{0.0f, 0.0f, 0.0f, 1.0f};
+    size_t executed_ = 0;
+    GpuPassTimer *timer_ = nullptr;
+};
@@ -0,0 +1,73 @@
+#include "frustum.h"
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4 &m)
+{
+    // Gribb/Hartmann: rows of the matrix combined with the w row
+    auto row = [&](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+    const glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+    Frustum f;
+    f.planes[0] = r3 + r0; // left
+    f.planes[1] = r3 - r0; // right
+    f.planes[2] = r3 + r1; // bottom
+    f.planes[3] = r3 - r1; // top
+    f.planes[4] = r3 + r2; // near
+    f.planes[5] = r3 - r2; // far
+    for (auto &p : f.planes)
+    {
+        float len = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+        if (len > 0.0f)
+            p = p * (1.0f / len);
+    }
+    return f;
+}
+
+bool Frustum::testBox(const glm::vec3 &c, const glm::vec3 &e) const
+{
+    for (const auto &p : planes)
+    {
+        float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+        float r = std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z;
+        if (d + r < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+void Frustum::testBoxes(const glm::vec3 *centers, const glm::vec3 *extents, size_t count, uint8_t *visible) const
+{
+    size_t i = 0;
+#ifdef FRUSTUM_SSE
+    // Transpose four boxes into SoA registers, then one pass per plane
+    for (; i + 4 <= count; i += 4)
+    {
+        const glm::vec3 *c = centers + i, *e = extents + i;
+        __m128 cx = _mm_setr_ps(c[0].x, c[1].x, c[2].x, c[3].x);
+        __m128 cy = _mm_setr_ps(c[0].y, c[1].y, c[2].y, c[3].y);
+        __m128 cz = _mm_setr_ps(c[0].z, c[1].z, c[2].z, c[3].z);
+        __m128 ex = _mm_setr_ps(e[0].x, e[1].x, e[2].x, e[3].x);
+        __m128 ey = _mm_setr_ps(e[0].y, e[1].y, e[2].y, e[3].y);
+        __m128 ez = _mm_setr_ps(e[0].z, e[1].z, e[2].z, e[3].z);
+        __m128 outside = _mm_setzero_ps();
+        for (const auto &p : planes)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), cx), _mm_mul_ps(_mm_set1_ps(p.y), cy)),
+                                  _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.z), cz), _mm_set1_ps(p.w)));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(p.x)), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(p.y)), ey)),
+                                  _mm_mul_ps(_mm_set1_ps(std::fabs(p.z)), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        visible[i + 0] = (mask & 1) ? 0 : 1;
+        visible[i + 1] = (mask & 2) ? 0 : 1;
+        visible[i + 2] = (mask & 4) ? 0 : 1;
+        visible[i + 3] = (mask & 8) ? 0 : 1;
+    }
+#endif
+    for (; i < count; ++i)
+        visible[i] = testBox(centers[i], extents[i]) ? 1 : 0;
+}
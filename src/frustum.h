@@ -0,0 +1,19 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// Six clip planes extracted from a view-projection matrix (perspective or ortho).
+// Plane normals point inward; a point p is inside a plane when dot(n, p) + w >= 0.
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4 &viewProj);
+
+    // Conservative: boxes straddling a corner may pass
+    bool testBox(const glm::vec3 &center, const glm::vec3 &extent) const;
+    // visible[i] = 1 when box i (center/half extent) intersects the frustum.
+    // Four boxes per iteration with SSE where available.
+    void testBoxes(const glm::vec3 *centers, const glm::vec3 *extents, size_t count, uint8_t *visible) const;
+};
@@ -0,0 +1,189 @@
+#include "gl_state.h"
+
+GLState &glState()
+{
+    static GLState state;
+    return state;
+}
+
+int GLState::capIndex(GLenum cap)
+{
+    switch (cap)
+    {
+    case GL_CULL_FACE: return CapCull;
+    case GL_DEPTH_TEST: return CapDepth;
+    case GL_BLEND: return CapBlend;
+    case GL_POLYGON_OFFSET_FILL: return CapPolyOffset;
+    default: return -1;
+    }
+}
+
+int GLState::targetIndex(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D: return Tex2D;
+    case GL_TEXTURE_2D_ARRAY: return Tex2DArray;
+    case GL_TEXTURE_CUBE_MAP: return TexCube;
+    default: return -1;
+    }
+}
+
+void GLState::useProgram(GLuint program)
+{
+    if (changed(program_ != program))
+    {
+        glUseProgram(program);
+        program_ = program;
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao)
+{
+    if (changed(vao_ != vao))
+    {
+        glBindVertexArray(vao);
+        vao_ = vao;
+    }
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint tex)
+{
+    int t = targetIndex(target);
+    if (unit >= (GLuint)kMaxTextureUnits || t < 0)
+    {
+        // untracked: forward and forget what we knew about the active unit
+        ++stats_.issued;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, tex);
+        activeUnit_ = unit;
+        return;
+    }
+    if (!changed(textures_[unit][t] != tex))
+        return;
+    if (activeUnit_ != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit_ = unit;
+    }
+    glBindTexture(target, tex);
+    textures_[unit][t] = tex;
+}
+
+void GLState::bindTextureForUpdate(GLenum target, GLuint tex)
+{
+    // unit 0 is the conventional upload slot; the elided case still leaves it active
+    bindTexture(0, target, tex);
+    if (activeUnit_ != 0)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        activeUnit_ = 0;
+    }
+}
+
+void GLState::bindFramebuffer(GLuint fbo)
+{
+    if (changed(fbo_ != fbo))
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        fbo_ = fbo;
+    }
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    if (changed(viewport_[0] != x || viewport_[1] != y || viewport_[2] != w || viewport_[3] != h))
+    {
+        glViewport(x, y, w, h);
+        viewport_[0] = x; viewport_[1] = y; viewport_[2] = w; viewport_[3] = h;
+    }
+}
+
+void GLState::setEnabled(GLenum cap, bool enabled)
+{
+    int c = capIndex(cap);
+    if (c >= 0 && !changed(caps_[c] != (enabled ? 1 : 0)))
+        return;
+    if (c < 0) ++stats_.issued;
+    if (enabled) glEnable(cap); else glDisable(cap);
+    if (c >= 0) caps_[c] = enabled ? 1 : 0;
+}
+
+void GLState::cullFace(GLenum face)
+{
+    if (changed(cullFace_ != face))
+    {
+        glCullFace(face);
+        cullFace_ = face;
+    }
+}
+
+void GLState::depthFunc(GLenum func)
+{
+    if (changed(depthFunc_ != func))
+    {
+        glDepthFunc(func);
+        depthFunc_ = func;
+    }
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+    if (changed(polygonMode_ != mode))
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+        polygonMode_ = mode;
+    }
+}
+
+void GLState::polygonOffset(GLfloat factor, GLfloat units)
+{
+    if (changed(!offsetKnown_ || offsetFactor_ != factor || offsetUnits_ != units))
+    {
+        glPolygonOffset(factor, units);
+        offsetFactor_ = factor;
+        offsetUnits_ = units;
+        offsetKnown_ = true;
+    }
+}
+
+void GLState::forgetProgram(GLuint program)
+{
+    if (program_ == program) program_ = kUnknown;
+}
+
+void GLState::forgetVertexArray(GLuint vao)
+{
+    if (vao_ == vao) vao_ = kUnknown;
+}
+
+void GLState::forgetTexture(GLuint tex)
+{
+    for (auto &unit : textures_)
+        for (auto &t : unit)
+            if (t == tex) t = kUnknown;
+}
+
+void GLState::forgetFramebuffer(GLuint fbo)
+{
+    if (fbo_ == fbo) fbo_ = kUnknown;
+}
+
+void GLState::invalidate()
+{
+    program_ = vao_ = fbo_ = activeUnit_ = kUnknown;
+    for (auto &unit : textures_)
+        for (auto &t : unit)
+            t = kUnknown;
+    viewport_[0] = viewport_[1] = viewport_[2] = viewport_[3] = -1;
+    for (int &c : caps_) c = -1;
+    cullFace_ = depthFunc_ = polygonMode_ = 0;
+    offsetKnown_ = false;
+}
+
+GLState::Stats GLState::endFrame()
+{
+    Stats s = stats_;
+    stats_ = Stats{};
+    return s;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <glad/gl.h>
+
+// Thin cache in front of the GL state machine. Every bind/enable in the
+// renderer goes through here so unchanged state never reaches the driver.
+// Anything that touches the same state directly must call invalidate().
+class GLState
+{
+public:
+    struct Stats
+    {
+        unsigned issued = 0; // calls forwarded to GL
+        unsigned elided = 0; // calls dropped because the state already matched
+    };
+
+    static constexpr int kMaxTextureUnits = 16;
+
+    GLState() { invalidate(); }
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void bindTexture(GLuint unit, GLenum target, GLuint tex);
+    // Bind on unit 0 and leave it active so glTex* calls that follow edit `tex`
+    void bindTextureForUpdate(GLenum target, GLuint tex);
+    void bindFramebuffer(GLuint fbo);
+    void viewport(GLint x, GLint y, GLsizei w, GLsizei h);
+    // Tracked caps: GL_CULL_FACE, GL_DEPTH_TEST, GL_BLEND, GL_POLYGON_OFFSET_FILL; others pass through
+    void setEnabled(GLenum cap, bool enabled);
+    void cullFace(GLenum face);
+    void depthFunc(GLenum func);
+    void polygonMode(GLenum mode); // GL_FRONT_AND_BACK
+    void polygonOffset(GLfloat factor, GLfloat units);
+
+    // Drop cached entries for objects about to be deleted (GL unbinds them implicitly)
+    void forgetProgram(GLuint program);
+    void forgetVertexArray(GLuint vao);
+    void forgetTexture(GLuint tex);
+    void forgetFramebuffer(GLuint fbo);
+    // Forget everything; the next call for each piece of state is always issued
+    void invalidate();
+
+    // Counters since the last endFrame(); returns them and starts a new frame
+    Stats endFrame();
+    const Stats &frameStats() const { return stats_; }
+
+private:
+    enum Cap { CapCull, CapDepth, CapBlend, CapPolyOffset, CapCount };
+    enum TexTarget { Tex2D, Tex2DArray, TexCube, TexTargetCount };
+    static int capIndex(GLenum cap);
+    static int targetIndex(GLenum target);
+    bool changed(bool differs)
+    {
+        if (differs) ++stats_.issued; else ++stats_.elided;
+        return differs;
+    }
+
+    static constexpr GLuint kUnknown = ~0u;
+    GLuint program_ = kUnknown;
+    GLuint vao_ = kUnknown;
+    GLuint fbo_ = kUnknown;
+    GLuint activeUnit_ = kUnknown;
+    GLuint textures_[kMaxTextureUnits][TexTargetCount];
+    GLint viewport_[4];
+    int caps_[CapCount]; // -1 unknown, 0 off, 1 on
+    GLenum cullFace_ = 0, depthFunc_ = 0, polygonMode_ = 0;
+    GLfloat offsetFactor_ = 0.0f, offsetUnits_ = 0.0f;
+    bool offsetKnown_ = false;
+    Stats stats_;
+};
+
+// Process-wide tracker for the single GL context
+GLState &glState();
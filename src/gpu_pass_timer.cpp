@@ -0,0 +1,58 @@
+#include "gpu_pass_timer.h"
+
+GpuPassTimer::~GpuPassTimer()
+{
+    for (Frame &f : frames_)
+        if (!f.queries.empty())
+            glDeleteQueries((GLsizei)f.queries.size(), f.queries.data());
+}
+
+void GpuPassTimer::beginFrame()
+{
+    current_ = (current_ + 1) % kFramesInFlight;
+    collect(frames_[current_]);
+}
+
+void GpuPassTimer::begin(const std::string &pass)
+{
+    if (current_ < 0)
+        return;
+    Frame &f = frames_[current_];
+    if (f.passes.size() == f.queries.size())
+    {
+        GLuint q = 0;
+        glGenQueries(1, &q);
+        f.queries.push_back(q);
+    }
+    glBeginQuery(GL_TIME_ELAPSED, f.queries[f.passes.size()]);
+    f.passes.push_back(pass);
+}
+
+void GpuPassTimer::end()
+{
+    if (current_ >= 0)
+        glEndQuery(GL_TIME_ELAPSED);
+}
+
+void GpuPassTimer::finish()
+{
+    // oldest first, so each pass's samples stay in frame order
+    for (int i = 1; i <= kFramesInFlight; ++i)
+        collect(frames_[(current_ + i) % kFramesInFlight]);
+}
+
+void GpuPassTimer::collect(Frame &frame)
+{
+    if (frame.passes.empty())
+        return;
+    std::map<std::string, double> sums;
+    for (size_t i = 0; i < frame.passes.size(); ++i)
+    {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &ns); // waits only if still in flight
+        sums[frame.passes[i]] += (double)ns * 1e-6;
+    }
+    for (const auto &s : sums)
+        results_[s.first].push_back(s.second);
+    frame.passes.clear();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/gl.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// GL_TIME_ELAPSED around each frame graph pass. Queries are read back
+// kFramesInFlight frames later, so the CPU only waits when the GPU is that far
+// behind. Passes sharing a name within a frame add up (the shadow cascades).
+class GpuPassTimer
+{
+public:
+    static constexpr int kFramesInFlight = 4;
+
+    ~GpuPassTimer();
+
+    // Collects the oldest frame in flight, then starts recording a new one
+    void beginFrame();
+    // Time-elapsed queries cannot nest: end() before the next begin()
+    void begin(const std::string &pass);
+    void end();
+    // Wait for and collect every frame still in flight
+    void finish();
+
+    // Milliseconds per collected frame, by pass name
+    const std::map<std::string, std::vector<double>> &results() const { return results_; }
+
+private:
+    struct Frame
+    {
+        std::vector<GLuint> queries;
+        std::vector<std::string> passes; // one per used query
+    };
+    void collect(Frame &frame);
+
+    Frame frames_[kFramesInFlight];
+    int current_ = -1;
+    std::map<std::string, std::vector<double>> results_;
+};
@@ -0,0 +1,86 @@
+#include "instance_buffer.h"
+#include <cstddef>
+
+InstanceData InstanceData::fromMatrix(const glm::mat4 &model)
+{
+    InstanceData d;
+    glm::mat3 n = glm::mat3(glm::transpose(glm::inverse(model)));
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+            d.model[c * 4 + r] = model[c][r];
+    for (int c = 0; c < 3; ++c)
+        for (int r = 0; r < 3; ++r)
+            d.normal[c * 3 + r] = n[c][r];
+    return d;
+}
+
+InstanceData InstanceData::fromTranslateScale(const glm::vec3 &position, const glm::vec3 &scale)
+{
+    InstanceData d{};
+    d.model[0] = scale.x;
+    d.model[5] = scale.y;
+    d.model[10] = scale.z;
+    d.model[12] = position.x;
+    d.model[13] = position.y;
+    d.model[14] = position.z;
+    d.model[15] = 1.0f;
+    d.normal[0] = 1.0f / scale.x;
+    d.normal[4] = 1.0f / scale.y;
+    d.normal[8] = 1.0f / scale.z;
+    return d;
+}
+
+InstanceBuffer::InstanceBuffer()
+{
+    static uint32_t nextSerial = 1;
+    serial_ = nextSerial++;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+    if (vbo_)
+        glDeleteBuffers(1, &vbo_);
+}
+
+void InstanceBuffer::upload(const InstanceData *data, size_t count)
+{
+    if (!vbo_)
+        glGenBuffers(1, &vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    const size_t bytes = count * sizeof(InstanceData);
+    if (count > capacity_)
+    {
+        capacity_ = count;
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STREAM_DRAW);
+    }
+    else
+    {
+        // orphan the old storage so in-flight draws keep their copy
+        glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    }
+    count_ = (GLsizei)count;
+}
+
+void InstanceBuffer::attachTo(uint32_t &attached) const
+{
+    if (attached == serial_ || !vbo_)
+        return;
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    const GLsizei stride = sizeof(InstanceData);
+    for (GLuint c = 0; c < 4; ++c)
+    {
+        GLuint loc = kFirstLocation + c;
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, stride, (void *)(offsetof(InstanceData, model) + c * 4 * sizeof(float)));
+        glVertexAttribDivisor(loc, 1);
+    }
+    for (GLuint c = 0; c < 3; ++c)
+    {
+        GLuint loc = kFirstLocation + 4 + c;
+        glEnableVertexAttribArray(loc);
+        glVertexAttribPointer(loc, 3, GL_FLOAT, GL_FALSE, stride, (void *)(offsetof(InstanceData, normal) + c * 3 * sizeof(float)));
+        glVertexAttribDivisor(loc, 1);
+    }
+    attached = serial_;
+}
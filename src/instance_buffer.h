@@ -0,0 +1,44 @@
+#pragma once
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Per-instance vertex attributes consumed by pbr.vert/shadow.vert:
+// model matrix at locations 4-7, normal matrix at locations 8-10.
+struct InstanceData
+{
+    float model[16];
+    float normal[9];
+
+    static InstanceData fromMatrix(const glm::mat4 &model);
+    // translate * scale; the normal matrix is the reciprocal scale, no inverse needed
+    static InstanceData fromTranslateScale(const glm::vec3 &position, const glm::vec3 &scale);
+};
+
+// Instance VBO shared by any number of VAOs. Each VAO records which buffer its
+// instance attributes point at (see attachTo), so re-uploads never rebind.
+class InstanceBuffer
+{
+public:
+    static constexpr GLuint kFirstLocation = 4;
+
+    InstanceBuffer();
+    ~InstanceBuffer();
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    void upload(const InstanceData *data, size_t count);
+    void upload(const std::vector<InstanceData> &data) { upload(data.data(), data.size()); }
+    GLsizei count() const { return count_; }
+
+    // Point the instance attributes of the currently bound VAO at this buffer.
+    // `attached` is the VAO's record of its current source; skipped when it already matches.
+    void attachTo(uint32_t &attached) const;
+
+private:
+    GLuint vbo_ = 0;
+    size_t capacity_ = 0;
+    GLsizei count_ = 0;
+    uint32_t serial_ = 0; // unique per buffer, unlike GL names which get reused
+};
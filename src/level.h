@@ -1,5 +1,6 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include "controller.h" // for AABB
@@ -14,7 +15,11 @@ public:
     bool loadFromIni(const std::string& path);
     const std::vector<AABB>& colliders() const { return colliders_; }
     const std::vector<LevelInstance>& instances() const { return instances_; }
+    // Mutable access counts as an edit: pass instancesRevision() to Renderer::submitInstances
+    std::vector<LevelInstance>& editInstances() { ++instancesRevision_; return instances_; }
+    uint64_t instancesRevision() const { return instancesRevision_; }
 private:
     std::vector<AABB> colliders_;
     std::vector<LevelInstance> instances_;
+    uint64_t instancesRevision_ = 0;
 };
@@ -13,6 +13,11 @@
 #include "controller.h"
 #include "level.h"
 #include "voxel_world.h"
+#include "collision_grid.h"
+#include "gl_state.h"
+#include "texture_streamer.h"
+#include "bench.h"
+#include "profiler.h"
 #include <vector>
 #include <string>
 
@@ -21,7 +26,8 @@ struct AppState
     Controller *controller = nullptr;
     float fovDeg = 90.0f; // adjustable FOV (degrees)
     bool captureMouse = true;
-    std::vector<AABB> world; // level collision
+    std::string tracePath; // F3 writes the profiler trace here
+    CollisionGrid world; // level collision
     // Debug
     bool dbgWireframe = false;
     bool dbgDisableCull = false;
@@ -48,6 +54,10 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
     {
         toggle_capture(window, s, !s->captureMouse);
     }
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS && Profiler::kEnabled)
+    {
+        profiler().writeChromeTrace(s->tracePath);
+    }
     if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
     {
         // Toggle wireframe and culling disable alternately
@@ -75,9 +85,13 @@ static void glfw_error_callback(int error, const char *description)
     std::fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-int main()
+int main(int argc, char **argv)
 {
     glfwSetErrorCallback(glfw_error_callback);
+    BenchOptions bench;
+    if (parseBenchArgs(argc, argv, bench))
+        return runBench(bench);
+    PROFILE_THREAD("main");
     if (!glfwInit())
     {
         std::fprintf(stderr, "Failed to initialize GLFW\n");
@@ -118,6 +132,7 @@ int main()
 
     // App/input setup
     AppState state{};
+    state.tracePath = bench.tracePath.empty() ? "trace.json" : bench.tracePath;
     glfwSetWindowUserPointer(window, &state);
     glfwSetKeyCallback(window, key_callback);
     glfwSetCursorPosCallback(window, cursor_pos_callback);
@@ -158,9 +173,18 @@ int main()
     VoxelWorld vox;
     vox.setCollisionScale(1.0f);
     vox.buildFromLevel(level);
-    state.world = vox.colliders();
+    state.world.build(vox.colliders());
+    // Fixed-rate simulation; rendering interpolates between the last two steps
+    const double simStep = 1.0 / 120.0;
+    const int maxSimSteps = 8; // catch-up cap; beyond it simulated time falls behind
+    double simAccumulator = 0.0;
+    // Per-second summary of frame rate and GL state changes elided by the tracker
+    double statsStart = lastTime;
+    unsigned statsFrames = 0;
+    GLState::Stats statsSum;
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_SCOPE("frame");
         double now = glfwGetTime();
         float dt = float(now - lastTime);
         lastTime = now;
@@ -173,8 +197,19 @@ int main()
         glm::mat4 proj = glm::perspective(glm::radians(state.fovDeg), aspect, 0.1f, 200.0f);
         glm::mat4 view(1.0f);
         // Controller update and movement
+        simAccumulator += dt;
+        int simSteps = 0;
+        while (simAccumulator >= simStep && simSteps < maxSimSteps)
+        {
+            if (state.controller)
+                state.controller->update(window, (float)simStep, state.world);
+            simAccumulator -= simStep;
+            ++simSteps;
+        }
+        if (simAccumulator >= simStep)
+            simAccumulator = std::fmod(simAccumulator, simStep); // hitch: drop the backlog
         if (state.controller)
-            state.controller->update(window, dt, state.world);
+            state.controller->interpolate((float)(simAccumulator / simStep));
 
         // Adjust FOV with Z (decrease) / X (increase)
         const float fovRate = 60.0f; // deg per second
@@ -187,22 +222,47 @@ int main()
         {
             view = state.controller->view();
         }
-        renderer.setCamera(proj, view, state.controller ? state.controller->position() : glm::vec3(0));
+        renderer.setCamera(proj, view, state.controller ? state.controller->eyePosition() : glm::vec3(0));
     renderer.setLightDir(glm::normalize(glm::vec3(-0.3f, -1.0f, -0.2f)));
     renderer.setDebugOptions(state.dbgWireframe, state.dbgDisableCull);
+    textureStreamer().update(); // finished background loads, within the per-frame upload budget
+    renderer.beginFrame();
 
     // Visualize voxels using grid.png with box-projected UVs; keep scale tied to collision
     const float uvTilesPerMeter = 1.0f; // tweak if needed
-    renderer.drawVoxels(vox, 0.75f, uvTilesPerMeter);
+    renderer.submitVoxels(vox, 0.75f, uvTilesPerMeter);
     // Optional: overlay collision boxes for visual vs collision scale check when culling disabled debug is active
     if (state.dbgDisableCull) {
-        renderer.drawColliders(state.world);
+        renderer.submitColliders(state.world.boxes());
     }
+    renderer.endFrame();
 
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+
+        GLState::Stats frameStats = glState().endFrame();
+        statsSum.issued += frameStats.issued;
+        statsSum.elided += frameStats.elided;
+        ++statsFrames;
+        if (now - statsStart >= 1.0)
+        {
+            char title[128];
+            std::snprintf(title, sizeof(title), "Qoom | %.0f fps | state changes/frame: %u issued, %u elided",
+                          statsFrames / (now - statsStart), statsSum.issued / statsFrames, statsSum.elided / statsFrames);
+            glfwSetWindowTitle(window, title);
+            statsStart = now;
+            statsFrames = 0;
+            statsSum = GLState::Stats{};
+        }
     }
 
+    profiler().shutdownGpu();
+    if (Profiler::kEnabled && !bench.tracePath.empty())
+        profiler().writeChromeTrace(bench.tracePath);
+    textureStreamer().shutdown();
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
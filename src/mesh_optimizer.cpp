@@ -0,0 +1,270 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace MeshOptimizer
+{
+
+float acmr(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned cacheSize)
+{
+    if (indexCount < 3)
+        return 0.0f;
+    // FIFO: a vertex is still cached while fewer than cacheSize misses happened since it entered
+    std::vector<uint32_t> stamp(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t v = indices[i];
+        if (time - stamp[v] > cacheSize)
+        {
+            stamp[v] = time++;
+            ++misses;
+        }
+    }
+    return (float)misses / (float)(indexCount / 3);
+}
+
+namespace
+{
+constexpr int kCacheSize = 32; // modelled LRU size for scoring
+
+float vertexScore(int cachePos, uint32_t remaining)
+{
+    if (remaining == 0)
+        return -1.0f; // no triangles left; never worth picking for
+    float score = 0.0f;
+    if (cachePos >= 0)
+    {
+        // the last triangle's vertices get a fixed score so the strip does not
+        // simply continue through the most recent edge every time
+        if (cachePos < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - (float)(cachePos - 3) / (float)(kCacheSize - 3), 1.5f);
+    }
+    // favour vertices with few triangles left so they are finished and leave the cache
+    return score + 2.0f / std::sqrt((float)remaining);
+}
+} // namespace
+
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+    const size_t triCount = indexCount / 3;
+    if (triCount == 0)
+        return;
+
+    // vertex -> triangles adjacency (CSR); remaining[v] counts the live prefix of each list
+    std::vector<uint32_t> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triCount * 3; ++i)
+        ++remaining[indices[i]];
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<uint32_t> adjacency(triCount * 3), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triCount; ++t)
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> vscore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vscore[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> tscore(triCount);
+    for (size_t t = 0; t < triCount; ++t)
+        tscore[t] = vscore[indices[t * 3]] + vscore[indices[t * 3 + 1]] + vscore[indices[t * 3 + 2]];
+
+    std::vector<uint8_t> emitted(triCount, 0);
+    std::vector<uint32_t> out(triCount * 3);
+    uint32_t cache[kCacheSize + 3];
+    int cacheCount = 0;
+    size_t cursor = 0; // restart point when nothing in the cache has triangles left
+    int64_t best = -1;
+
+    for (size_t o = 0; o < triCount; ++o)
+    {
+        if (best < 0)
+        {
+            while (emitted[cursor])
+                ++cursor;
+            best = (int64_t)cursor;
+        }
+        const uint32_t t = (uint32_t)best;
+        const uint32_t *tri = indices + (size_t)t * 3;
+        emitted[t] = 1;
+        out[o * 3 + 0] = tri[0];
+        out[o * 3 + 1] = tri[1];
+        out[o * 3 + 2] = tri[2];
+
+        // the emitted triangle's vertices move to the front, the rest shift back
+        uint32_t next[kCacheSize + 3];
+        int n = 0;
+        for (int k = 0; k < 3; ++k)
+            next[n++] = tri[k];
+        for (int i = 0; i < cacheCount; ++i)
+            if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                next[n++] = cache[i];
+
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = tri[k];
+            uint32_t *list = adjacency.data() + offsets[v];
+            for (uint32_t i = 0; i < remaining[v]; ++i)
+                if (list[i] == t)
+                {
+                    list[i] = list[remaining[v] - 1];
+                    --remaining[v];
+                    break;
+                }
+        }
+
+        // rescore everything that entered, moved within or fell out of the cache
+        for (int i = 0; i < n; ++i)
+        {
+            uint32_t v = next[i];
+            cachePos[v] = i < kCacheSize ? i : -1;
+            float s = vertexScore(cachePos[v], remaining[v]);
+            float delta = s - vscore[v];
+            vscore[v] = s;
+            const uint32_t *list = adjacency.data() + offsets[v];
+            for (uint32_t j = 0; j < remaining[v]; ++j)
+                tscore[list[j]] += delta;
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        cacheCount = std::min(n, kCacheSize);
+        for (int i = 0; i < cacheCount; ++i)
+        {
+            uint32_t v = next[i];
+            cache[i] = v;
+            const uint32_t *list = adjacency.data() + offsets[v];
+            for (uint32_t j = 0; j < remaining[v]; ++j)
+                if (tscore[list[j]] > bestScore)
+                {
+                    bestScore = tscore[list[j]];
+                    best = list[j];
+                }
+        }
+    }
+    std::copy(out.begin(), out.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const glm::vec3 *positions, size_t vertexCount, float threshold)
+{
+    const size_t triCount = indexCount / 3;
+    if (triCount < 2)
+        return;
+
+    // FIFO cache simulation; advancing time by more than the cache size empties it
+    const unsigned cacheSize = 16;
+    std::vector<uint32_t> stamp(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    auto misses = [&](size_t t) {
+        unsigned m = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = indices[t * 3 + k];
+            if (time - stamp[v] > cacheSize)
+            {
+                stamp[v] = time++;
+                ++m;
+            }
+        }
+        return m;
+    };
+
+    // Hard boundaries: triangles whose three vertices all miss the cache start a cluster
+    std::vector<uint8_t> triMisses(triCount);
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        triMisses[t] = (uint8_t)misses(t);
+        if (t == 0 || triMisses[t] == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triCount);
+
+    // Soft boundaries: inside a hard cluster, cut wherever the run since the last
+    // cut, simulated from a cold cache, is already within threshold of the
+    // cluster's ACMR; every cut is a cold start once clusters are reordered
+    std::vector<size_t> starts;
+    for (size_t h = 0; h + 1 < hard.size(); ++h)
+    {
+        size_t begin = hard[h], end = hard[h + 1];
+        size_t clusterMisses = 0;
+        for (size_t t = begin; t < end; ++t)
+            clusterMisses += triMisses[t];
+        const float clusterAcmr = (float)clusterMisses / (float)(end - begin);
+        starts.push_back(begin);
+        time += cacheSize + 1;
+        size_t runMisses = 0, runStart = begin;
+        for (size_t t = begin; t < end; ++t)
+        {
+            runMisses += misses(t);
+            if (t + 1 < end && (float)runMisses / (float)(t + 1 - runStart) <= clusterAcmr * threshold)
+            {
+                starts.push_back(t + 1);
+                runStart = t + 1;
+                runMisses = 0;
+                time += cacheSize + 1;
+            }
+        }
+    }
+    starts.push_back(triCount);
+
+    // Area-weighted centroid and normal per cluster
+    const size_t clusterCount = starts.size() - 1;
+    std::vector<glm::vec3> centroid(clusterCount, glm::vec3(0.0f)), normal(clusterCount, glm::vec3(0.0f));
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        float area = 0.0f;
+        for (size_t t = starts[c]; t < starts[c + 1]; ++t)
+        {
+            const glm::vec3 &a = positions[indices[t * 3]], &b = positions[indices[t * 3 + 1]], &d = positions[indices[t * 3 + 2]];
+            glm::vec3 n = glm::cross(b - a, d - a); // length = 2 * area
+            float w = glm::length(n);
+            centroid[c] += (a + b + d) * (w / 3.0f);
+            normal[c] += n;
+            area += w;
+        }
+        meshCentroid += centroid[c];
+        meshArea += area;
+        centroid[c] = area > 0.0f ? centroid[c] / area : positions[indices[starts[c] * 3]];
+        float len = glm::length(normal[c]);
+        normal[c] = len > 0.0f ? normal[c] / len : glm::vec3(0.0f);
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<uint32_t> order(clusterCount);
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c)
+    {
+        order[c] = (uint32_t)c;
+        sortKey[c] = glm::dot(centroid[c] - meshCentroid, normal[c]);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<uint32_t> out;
+    out.reserve(triCount * 3);
+    for (uint32_t c : order)
+        out.insert(out.end(), indices + starts[c] * 3, indices + starts[c + 1] * 3);
+    std::copy(out.begin(), out.end(), indices);
+}
+
+std::vector<uint32_t> optimizeVertexFetch(uint32_t *indices, size_t indexCount, size_t vertexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, kUnused);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t &r = remap[indices[i]];
+        if (r == kUnused)
+            r = next++;
+        indices[i] = r;
+    }
+    return remap;
+}
+
+} // namespace MeshOptimizer
@@ -0,0 +1,30 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Offline index/vertex reordering for static triangle lists, run once when a
+// model is cooked. All functions take a triangle list of `indexCount` indices
+// referencing `vertexCount` vertices and rewrite it in place.
+namespace MeshOptimizer
+{
+constexpr uint32_t kUnused = ~0u;
+
+// Average vertex shader invocations per triangle through a FIFO post-transform cache
+float acmr(const uint32_t *indices, size_t indexCount, size_t vertexCount, unsigned cacheSize = 16);
+
+// Forsyth's linear-speed vertex cache optimisation: greedily emit the triangle
+// whose vertices score highest (recently used, few remaining triangles)
+void optimizeVertexCache(uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+// Split a cache-optimised list into clusters where the cache effectively
+// restarts, then order the clusters outward-facing first so near surfaces
+// tend to draw before what they occlude. `threshold` bounds the ACMR a
+// cluster split may cost relative to its parent (1.05 = 5% worse).
+void optimizeOverdraw(uint32_t *indices, size_t indexCount, const glm::vec3 *positions, size_t vertexCount, float threshold = 1.05f);
+
+// Renumber vertices in order of first use so fetches walk the vertex buffer
+// forwards. Returns old -> new (kUnused for unreferenced vertices).
+std::vector<uint32_t> optimizeVertexFetch(uint32_t *indices, size_t indexCount, size_t vertexCount);
+} // namespace MeshOptimizer
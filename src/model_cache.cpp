@@ -0,0 +1,591 @@
+#include "model_cache.h"
+#include "block_compress.h"
+#include <glad/gl.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// On-disk layout: header, fixed-size record tables, then 16-byte aligned blobs.
+// Offsets are from the start of the file.
+namespace
+{
+constexpr char kMagic[4] = {'Q', 'M', 'C', '1'};
+constexpr uint32_t kVersion = 9; // bump on any change to the records or the cooked vertex layout
+
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash, sourceSize;
+    int64_t sourceMtime;
+    uint32_t importFlags, cookFlags;
+    uint32_t meshCount, materialCount, textureCount, mipCount, depCount, pad;
+    uint64_t fileBytes;
+};
+
+struct MeshRecord
+{
+    uint32_t vertexStride, indexType, indexCount;
+    int32_t materialIndex;
+    float boundsMin[3], boundsMax[3];
+    uint64_t vertexOffset, vertexBytes, indexOffset, indexBytes;
+};
+
+struct MaterialRecord
+{
+    int32_t baseColorTex, occlusionTex, roughMetalTex, normalTex;
+    float baseColorFactor[4];
+    float metallicFactor, roughnessFactor;
+};
+
+struct TextureRecord
+{
+    uint64_t contentHash;
+    uint32_t srgb, internalFormat, format, type, firstMip, mipCount;
+};
+
+struct MipRecord
+{
+    uint32_t width, height;
+    uint64_t offset, bytes;
+};
+
+struct DepRecord
+{
+    uint64_t hash, size;
+    int64_t mtime;
+    uint64_t pathOffset, pathBytes;
+};
+
+static_assert(sizeof(FileHeader) == 72 && sizeof(MeshRecord) == 72 && sizeof(MaterialRecord) == 40 &&
+                  sizeof(TextureRecord) == 32 && sizeof(MipRecord) == 24 && sizeof(DepRecord) == 40,
+              "cooked records are written as raw bytes");
+
+uint64_t align16(uint64_t v) { return (v + 15) & ~uint64_t(15); }
+
+// Copy a record out of the mapping (the tables are 8-byte aligned, but this keeps
+// the reader independent of how the bytes were obtained)
+template <class T>
+bool readRecord(const MappedFile &file, uint64_t offset, T &out)
+{
+    if (offset + sizeof(T) > file.size()) return false;
+    std::memcpy(&out, file.data() + offset, sizeof(T));
+    return true;
+}
+
+bool inFile(const MappedFile &file, uint64_t offset, uint64_t bytes)
+{
+    return offset <= file.size() && bytes <= file.size() - offset;
+}
+
+// -1 (none) or an index into the texture table
+bool validTexture(int32_t index, uint32_t textureCount) { return index >= -1 && (index < 0 || (uint32_t)index < textureCount); }
+
+// The draw reads indexCount indices of indexType from the blob
+bool validIndices(const MeshRecord &r)
+{
+    uint64_t size = r.indexType == GL_UNSIGNED_SHORT ? 2 : r.indexType == GL_UNSIGNED_INT ? 4 : 0;
+    return size != 0 && (uint64_t)r.indexCount * size <= r.indexBytes;
+}
+} // namespace
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (p == MAP_FAILED) return false;
+    data_ = static_cast<const uint8_t *>(p);
+    size_ = (size_t)st.st_size;
+    mapped_ = true;
+    return true;
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    std::streamsize n = in.tellg();
+    if (n <= 0) return false;
+    buffer_.resize((size_t)n);
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char *>(buffer_.data()), n)) return false;
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return true;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (mapped_) munmap(const_cast<uint8_t *>(data_), size_);
+#endif
+    mapped_ = false;
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool hashFile(const std::string &path, uint64_t &out)
+{
+    MappedFile file;
+    if (!file.open(path)) return false;
+    out = hashBytes(file.data(), file.size());
+    return true;
+}
+
+bool statFile(const std::string &path, FileStamp &out)
+{
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+    const auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) return false;
+    out.size = (uint64_t)size;
+    out.mtime = (int64_t)time.time_since_epoch().count();
+    return true;
+}
+
+namespace
+{
+// Same stamp: assumed unchanged. Otherwise the contents decide (a touched but
+// identical file still matches).
+bool unchanged(const std::string &path, const FileStamp &stamp, uint64_t hash)
+{
+    FileStamp now;
+    if (!statFile(path, now)) return false;
+    if (now == stamp) return true;
+    uint64_t current = 0;
+    return hashFile(path, current) && current == hash;
+}
+} // namespace
+
+bool readCookedModel(const MappedFile &file, const CookKey &key, CookedModel &out)
+{
+    out = CookedModel{};
+    FileHeader h;
+    if (!readRecord(file, 0, h)) return false;
+    if (std::memcmp(h.magic, kMagic, 4) != 0 || h.version != kVersion || h.fileBytes != file.size()) return false;
+    if (h.importFlags != key.importFlags || h.cookFlags != key.cookFlags) return false;
+    if (!unchanged(key.sourcePath, {h.sourceSize, h.sourceMtime}, h.sourceHash)) return false;
+
+    // the record tables must fit before anything is sized from the counts
+    const uint64_t tableBytes = h.meshCount * (uint64_t)sizeof(MeshRecord) + h.materialCount * (uint64_t)sizeof(MaterialRecord) +
+                                h.textureCount * (uint64_t)sizeof(TextureRecord) + h.mipCount * (uint64_t)sizeof(MipRecord) +
+                                h.depCount * (uint64_t)sizeof(DepRecord);
+    if (!inFile(file, sizeof(FileHeader), tableBytes)) return false;
+
+    uint64_t at = sizeof(FileHeader);
+    std::vector<MipRecord> mips(h.mipCount);
+    bool ok = true;
+    out.meshes.resize(h.meshCount);
+    for (auto &m : out.meshes)
+    {
+        MeshRecord r;
+        ok = ok && readRecord(file, at, r) && inFile(file, r.vertexOffset, r.vertexBytes) && inFile(file, r.indexOffset, r.indexBytes) &&
+             validIndices(r) && r.materialIndex >= -1 && (r.materialIndex < 0 || (uint32_t)r.materialIndex < h.materialCount);
+        at += sizeof(MeshRecord);
+        if (!ok) break;
+        m.vertexStride = r.vertexStride;
+        m.indexType = r.indexType;
+        m.indexCount = r.indexCount;
+        m.materialIndex = r.materialIndex;
+        std::memcpy(m.boundsMin, r.boundsMin, sizeof(m.boundsMin));
+        std::memcpy(m.boundsMax, r.boundsMax, sizeof(m.boundsMax));
+        m.vertices = file.data() + r.vertexOffset;
+        m.vertexBytes = r.vertexBytes;
+        m.indices = file.data() + r.indexOffset;
+        m.indexBytes = r.indexBytes;
+    }
+    out.materials.resize(ok ? h.materialCount : 0);
+    for (auto &m : out.materials)
+    {
+        MaterialRecord r;
+        ok = ok && readRecord(file, at, r) && validTexture(r.baseColorTex, h.textureCount) && validTexture(r.occlusionTex, h.textureCount) &&
+             validTexture(r.roughMetalTex, h.textureCount) && validTexture(r.normalTex, h.textureCount);
+        at += sizeof(MaterialRecord);
+        if (!ok) break;
+        m.baseColorTex = r.baseColorTex;
+        m.occlusionTex = r.occlusionTex;
+        m.roughMetalTex = r.roughMetalTex;
+        m.normalTex = r.normalTex;
+        std::memcpy(m.baseColorFactor, r.baseColorFactor, sizeof(m.baseColorFactor));
+        m.metallicFactor = r.metallicFactor;
+        m.roughnessFactor = r.roughnessFactor;
+    }
+    std::vector<TextureRecord> texRecords(ok ? h.textureCount : 0);
+    for (auto &r : texRecords)
+    {
+        ok = ok && readRecord(file, at, r) && r.firstMip <= h.mipCount && r.mipCount <= h.mipCount - r.firstMip;
+        at += sizeof(TextureRecord);
+        if (!ok) break;
+    }
+    for (auto &r : mips)
+    {
+        ok = ok && readRecord(file, at, r) && inFile(file, r.offset, r.bytes);
+        at += sizeof(MipRecord);
+        if (!ok) break;
+    }
+    for (uint32_t i = 0; ok && i < h.depCount; ++i)
+    {
+        DepRecord r;
+        ok = readRecord(file, at, r) && inFile(file, r.pathOffset, r.pathBytes);
+        at += sizeof(DepRecord);
+        if (!ok) break;
+        CookedDependency dep;
+        dep.path.assign(reinterpret_cast<const char *>(file.data() + r.pathOffset), (size_t)r.pathBytes);
+        dep.hash = r.hash;
+        dep.stamp = {r.size, r.mtime};
+        // an external texture or buffer that changed or vanished invalidates the whole file
+        ok = unchanged(dep.path, dep.stamp, dep.hash);
+        out.dependencies.push_back(std::move(dep));
+    }
+    if (!ok)
+    {
+        out = CookedModel{};
+        return false;
+    }
+    for (const auto &r : texRecords)
+    {
+        CookedTexture tex;
+        tex.contentHash = r.contentHash;
+        tex.srgb = r.srgb != 0;
+        tex.internalFormat = r.internalFormat;
+        tex.format = r.format;
+        tex.type = r.type;
+        for (uint32_t i = 0; i < r.mipCount; ++i)
+        {
+            const MipRecord &mr = mips[r.firstMip + i];
+            tex.mips.push_back({mr.width, mr.height, file.data() + mr.offset, mr.bytes});
+        }
+        out.textures.push_back(std::move(tex));
+    }
+    return true;
+}
+
+bool writeCookedModel(const std::string &path, const CookKey &key, const CookedModel &model)
+{
+    FileHeader h{};
+    std::memcpy(h.magic, kMagic, 4);
+    h.version = kVersion;
+    h.sourceHash = key.sourceHash;
+    h.sourceSize = key.sourceStamp.size;
+    h.sourceMtime = key.sourceStamp.mtime;
+    h.importFlags = key.importFlags;
+    h.cookFlags = key.cookFlags;
+    h.meshCount = (uint32_t)model.meshes.size();
+    h.materialCount = (uint32_t)model.materials.size();
+    h.textureCount = (uint32_t)model.textures.size();
+    h.depCount = (uint32_t)model.dependencies.size();
+    for (const auto &t : model.textures) h.mipCount += (uint32_t)t.mips.size();
+
+    // Place every blob after the tables, in the order they are written below
+    std::vector<std::pair<const void *, uint64_t>> blobs;
+    uint64_t cursor = align16(sizeof(FileHeader) + h.meshCount * sizeof(MeshRecord) + h.materialCount * sizeof(MaterialRecord) +
+                              h.textureCount * sizeof(TextureRecord) + h.mipCount * sizeof(MipRecord) + h.depCount * sizeof(DepRecord));
+    auto place = [&](const void *data, uint64_t bytes) {
+        uint64_t offset = cursor;
+        blobs.push_back({data, bytes});
+        cursor = align16(cursor + bytes);
+        return offset;
+    };
+
+    std::vector<MeshRecord> meshes;
+    for (const auto &m : model.meshes)
+    {
+        MeshRecord r{};
+        r.vertexStride = m.vertexStride;
+        r.indexType = m.indexType;
+        r.indexCount = m.indexCount;
+        r.materialIndex = m.materialIndex;
+        std::memcpy(r.boundsMin, m.boundsMin, sizeof(r.boundsMin));
+        std::memcpy(r.boundsMax, m.boundsMax, sizeof(r.boundsMax));
+        r.vertexBytes = m.vertexBytes;
+        r.vertexOffset = place(m.vertices, m.vertexBytes);
+        r.indexBytes = m.indexBytes;
+        r.indexOffset = place(m.indices, m.indexBytes);
+        meshes.push_back(r);
+    }
+    std::vector<MaterialRecord> materials;
+    for (const auto &m : model.materials)
+    {
+        MaterialRecord r{};
+        r.baseColorTex = m.baseColorTex;
+        r.occlusionTex = m.occlusionTex;
+        r.roughMetalTex = m.roughMetalTex;
+        r.normalTex = m.normalTex;
+        std::memcpy(r.baseColorFactor, m.baseColorFactor, sizeof(r.baseColorFactor));
+        r.metallicFactor = m.metallicFactor;
+        r.roughnessFactor = m.roughnessFactor;
+        materials.push_back(r);
+    }
+    std::vector<TextureRecord> textures;
+    std::vector<MipRecord> mips;
+    for (const auto &t : model.textures)
+    {
+        textures.push_back({t.contentHash, t.srgb ? 1u : 0u, t.internalFormat, t.format, t.type, (uint32_t)mips.size(), (uint32_t)t.mips.size()});
+        for (const auto &mip : t.mips)
+            mips.push_back({mip.width, mip.height, place(mip.data, mip.bytes), mip.bytes});
+    }
+    std::vector<DepRecord> deps;
+    for (const auto &d : model.dependencies)
+        deps.push_back({d.hash, d.stamp.size, d.stamp.mtime, place(d.path.data(), d.path.size()), d.path.size()});
+    h.fileBytes = cursor;
+
+    // Write to a temporary and rename so a crash never leaves a truncated cache behind
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        auto write = [&](const void *data, size_t bytes) { out.write(static_cast<const char *>(data), (std::streamsize)bytes); };
+        write(&h, sizeof(h));
+        write(meshes.data(), meshes.size() * sizeof(MeshRecord));
+        write(materials.data(), materials.size() * sizeof(MaterialRecord));
+        write(textures.data(), textures.size() * sizeof(TextureRecord));
+        write(mips.data(), mips.size() * sizeof(MipRecord));
+        write(deps.data(), deps.size() * sizeof(DepRecord));
+        static const char zeros[16] = {};
+        for (const auto &b : blobs)
+        {
+            write(zeros, (size_t)(align16((uint64_t)out.tellp()) - (uint64_t)out.tellp()));
+            write(b.first, (size_t)b.second);
+        }
+        write(zeros, (size_t)(cursor - (uint64_t)out.tellp()));
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+// Mips (and blocks, with compress) from decoded 8-bit pixels
+void cookPixels(CookedModel &model, CookedTexture &tex, const uint8_t *pixels, int w, int h, int channels, TextureUsage usage, bool compress)
+{
+    const bool srgb = usage == TextureUsage::Color;
+    if (compress)
+    {
+        // the uncompressed chain only lives until its levels are encoded
+        CookedModel scratch;
+        cookTextureMips(scratch, tex, pixels, w, h, channels, srgb, usage == TextureUsage::Normal);
+        compressTextureMips(model, tex, usage);
+    }
+    else
+        cookTextureMips(model, tex, pixels, w, h, channels, srgb, usage == TextureUsage::Normal);
+}
+} // namespace
+
+bool cookImage(CookedModel &model, CookedTexture &tex, const uint8_t *encoded, size_t size, TextureUsage usage, bool compress)
+{
+    int w = 0, h = 0, c = 0;
+    if (!stbi_info_from_memory(encoded, (int)size, &w, &h, &c))
+        return false;
+    const int channels = (c == 2 || c == 4) ? 4 : 3;
+    unsigned char *data = stbi_load_from_memory(encoded, (int)size, &w, &h, &c, channels);
+    if (!data)
+        return false;
+    cookPixels(model, tex, data, w, h, channels, usage, compress);
+    stbi_image_free(data);
+    // the same image cooked for another usage is a different texture
+    const uint32_t variant[2] = {(uint32_t)usage, tex.internalFormat};
+    tex.contentHash = hashBytes(variant, sizeof(variant), hashBytes(encoded, size));
+    return true;
+}
+
+bool cookPackedImage(CookedModel &model, CookedTexture &tex, const PackedChannel *channels, int count, TextureUsage usage, bool compress)
+{
+    struct Decoded
+    {
+        unsigned char *data = nullptr;
+        int w = 0, h = 0, c = 0;
+    } src[4];
+    count = std::min(std::max(count, 1), 4);
+    int w = 0, h = 0;
+    bool ok = true;
+    for (int i = 0; i < count && ok; ++i)
+    {
+        if (!channels[i].encoded)
+            continue;
+        src[i].data = stbi_load_from_memory(channels[i].encoded, (int)channels[i].size, &src[i].w, &src[i].h, &src[i].c, 0);
+        ok = src[i].data != nullptr;
+        w = std::max(w, src[i].w);
+        h = std::max(h, src[i].h);
+    }
+    if (ok && w > 0 && h > 0)
+    {
+        // every source is point-sampled to the largest size
+        std::vector<uint8_t> pixels((size_t)w * h * count);
+        for (int i = 0; i < count; ++i)
+        {
+            const Decoded &d = src[i];
+            // grey (+alpha) sources hold their value in the first channel
+            const int from = d.c >= 3 ? std::min(channels[i].channel, d.c - 1) : 0;
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x)
+                {
+                    uint8_t v = channels[i].fill;
+                    if (d.data)
+                    {
+                        int sx = (int)((int64_t)x * d.w / w), sy = (int)((int64_t)y * d.h / h);
+                        v = d.data[((size_t)sy * d.w + sx) * d.c + from];
+                    }
+                    pixels[((size_t)y * w + x) * count + i] = v;
+                }
+        }
+        cookPixels(model, tex, pixels.data(), w, h, count, usage, compress);
+        const uint32_t variant[2] = {(uint32_t)usage, tex.internalFormat};
+        uint64_t hash = hashBytes(variant, sizeof(variant));
+        for (int i = 0; i < count; ++i)
+        {
+            const PackedChannel &pc = channels[i];
+            const uint32_t desc[3] = {pc.encoded ? 1u : 0u, (uint32_t)pc.channel, pc.fill};
+            hash = hashBytes(desc, sizeof(desc), pc.encoded ? hashBytes(pc.encoded, pc.size, hash) : hash);
+        }
+        tex.contentHash = hash;
+    }
+    for (const Decoded &d : src)
+        if (d.data)
+            stbi_image_free(d.data);
+    return ok && w > 0 && h > 0;
+}
+
+void cookTextureMips(CookedModel &model, CookedTexture &tex, const uint8_t *pixels, int width, int height, int channels, bool srgb,
+                     bool renormalize)
+{
+    tex.srgb = srgb;
+    switch (channels)
+    {
+    case 1: tex.internalFormat = GL_R8; tex.format = GL_RED; break; // linear only
+    case 2: tex.internalFormat = GL_RG8; tex.format = GL_RG; break;
+    case 3: tex.internalFormat = srgb ? GL_SRGB8 : GL_RGB8; tex.format = GL_RGB; break;
+    default: tex.internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8; tex.format = GL_RGBA; break;
+    }
+    tex.type = GL_UNSIGNED_BYTE;
+    tex.mips.clear();
+
+    float toLinear[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        float c = i / 255.0f;
+        toLinear[i] = srgb ? (c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f)) : c;
+    }
+    auto encode = [&](float v) -> uint8_t {
+        if (srgb) v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+        return (uint8_t)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+    };
+
+    std::vector<uint8_t> level(pixels, pixels + (size_t)width * height * channels);
+    int w = width, h = height;
+    for (;;)
+    {
+        const uint8_t *src = model.keep(std::vector<uint8_t>(level));
+        tex.mips.push_back({(uint32_t)w, (uint32_t)h, src, (uint64_t)level.size()});
+        if (w == 1 && h == 1) break;
+        // 2x2 box filter; odd edges repeat their last row/column
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        level.assign((size_t)nw * nh * channels, 0);
+        for (int y = 0; y < nh; ++y)
+            for (int x = 0; x < nw; ++x)
+            {
+                int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+                for (int c = 0; c < channels; ++c)
+                {
+                    auto at = [&](int px, int py) { return src[((size_t)py * w + px) * channels + c]; };
+                    uint8_t *dst = &level[((size_t)y * nw + x) * channels + c];
+                    if (c == 3) // alpha is always linear
+                        *dst = (uint8_t)((at(x0, y0) + at(x1, y0) + at(x0, y1) + at(x1, y1) + 2) / 4);
+                    else
+                        *dst = encode(0.25f * (toLinear[at(x0, y0)] + toLinear[at(x1, y0)] + toLinear[at(x0, y1)] + toLinear[at(x1, y1)]));
+                }
+                if (renormalize)
+                {
+                    // averaged normals shorten; push them back onto the unit sphere
+                    uint8_t *t = &level[((size_t)y * nw + x) * channels];
+                    float n[3] = {t[0] / 127.5f - 1.0f, t[1] / 127.5f - 1.0f, t[2] / 127.5f - 1.0f};
+                    float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (len > 1e-4f)
+                        for (int c = 0; c < 3; ++c)
+                            t[c] = (uint8_t)std::lround(std::min(std::max((n[c] / len + 1.0f) * 127.5f, 0.0f), 255.0f));
+                }
+            }
+        w = nw;
+        h = nh;
+    }
+}
+
+void compressTextureMips(CookedModel &model, CookedTexture &tex, TextureUsage usage)
+{
+    if (tex.compressed() || tex.mips.empty())
+        return;
+    const int channels = tex.format == GL_RGBA ? 4 : tex.format == GL_RGB ? 3 : tex.format == GL_RG ? 2 : 1;
+    BlockCompress::Format f = BlockCompress::Format::BC1;
+    switch (usage)
+    {
+    case TextureUsage::Color:
+    {
+        // BC3 only when the alpha channel carries something
+        bool translucent = false;
+        const CookedMip &top = tex.mips[0];
+        for (uint64_t i = 3; channels == 4 && i < top.bytes && !translucent; i += 4)
+            translucent = top.data[i] != 255;
+        f = translucent ? BlockCompress::Format::BC3 : BlockCompress::Format::BC1;
+        tex.internalFormat = translucent ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        break;
+    }
+    // Independent linear channels each get their own endpoints: BC1's single
+    // colour line per block would bleed them into each other
+    case TextureUsage::Mask:
+        f = BlockCompress::Format::BC4;
+        tex.internalFormat = GL_COMPRESSED_RED_RGTC1;
+        break;
+    case TextureUsage::Data:
+    case TextureUsage::Normal:
+        f = BlockCompress::Format::BC5;
+        tex.internalFormat = GL_COMPRESSED_RG_RGTC2;
+        break;
+    }
+    tex.format = 0;
+    tex.type = 0;
+    for (CookedMip &mip : tex.mips)
+    {
+        std::vector<uint8_t> blocks = BlockCompress::compressImage(f, mip.data, (int)mip.width, (int)mip.height, channels);
+        mip.bytes = blocks.size();
+        mip.data = model.keep(std::move(blocks));
+    }
+}
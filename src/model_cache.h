@@ -0,0 +1,165 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Cooked model format: vertex/index blobs in GPU layout, material records and
+// fully mipped texture levels, laid out so a memory-mapped file can be handed
+// to glBufferData/glTexImage2D without parsing. Pointers in the records below
+// point either into a MappedFile or into CookedModel::storage while cooking.
+
+struct CookedMesh
+{
+    uint32_t vertexStride = 0;
+    uint32_t indexType = 0; // GL_UNSIGNED_INT / GL_UNSIGNED_SHORT
+    uint32_t indexCount = 0;
+    int32_t materialIndex = -1;
+    float boundsMin[3] = {0, 0, 0}, boundsMax[3] = {0, 0, 0};
+    const uint8_t *vertices = nullptr;
+    uint64_t vertexBytes = 0;
+    const uint8_t *indices = nullptr;
+    uint64_t indexBytes = 0;
+};
+
+struct CookedMip
+{
+    uint32_t width = 0, height = 0;
+    const uint8_t *data = nullptr;
+    uint64_t bytes = 0;
+};
+
+struct CookedTexture
+{
+    uint64_t contentHash = 0; // of the encoded source image and how it was cooked; identifies it across models
+    bool srgb = false;
+    // glTexImage2D arguments; format == 0 means block compressed (glCompressedTexImage2D)
+    uint32_t internalFormat = 0, format = 0, type = 0;
+    std::vector<CookedMip> mips; // level 0 first
+
+    bool compressed() const { return format == 0; }
+};
+
+// What a texture holds, which decides how it is filtered and encoded
+enum class TextureUsage : uint32_t
+{
+    Color,  // sRGB colour: BC1, or BC3 when any texel is translucent
+    Mask,   // one linear channel in R (occlusion): BC4
+    Data,   // two linear channels in R and G (roughness, metalness): BC5
+    Normal, // tangent-space normal: BC5 keeps X and Y, the shader rebuilds Z
+};
+
+struct CookedMaterial
+{
+    // indices into CookedModel::textures, -1 = none
+    int32_t baseColorTex = -1, occlusionTex = -1, roughMetalTex = -1, normalTex = -1;
+    float baseColorFactor[4] = {1, 1, 1, 1};
+    float metallicFactor = 0.0f, roughnessFactor = 0.5f;
+};
+
+// Size and modification time: a cheap "unchanged" test before hashing contents
+struct FileStamp
+{
+    uint64_t size = 0;
+    int64_t mtime = 0; // filesystem clock ticks
+
+    bool operator==(const FileStamp &o) const { return size == o.size && mtime == o.mtime; }
+    bool operator!=(const FileStamp &o) const { return !(*this == o); }
+};
+bool statFile(const std::string &path, FileStamp &out);
+
+// A file the cooked data was derived from besides the source (external
+// textures and buffers)
+struct CookedDependency
+{
+    std::string path;
+    uint64_t hash = 0;
+    FileStamp stamp;
+};
+
+struct CookedModel
+{
+    std::vector<CookedMesh> meshes;
+    std::vector<CookedMaterial> materials;
+    std::vector<CookedTexture> textures;
+    std::vector<CookedDependency> dependencies;
+    // Owns blob memory while cooking (deque: earlier blobs never move)
+    std::deque<std::vector<uint8_t>> storage;
+
+    const uint8_t *keep(std::vector<uint8_t> &&blob)
+    {
+        storage.push_back(std::move(blob));
+        return storage.back().data();
+    }
+};
+
+// Identifies what a cooked file was built from; any mismatch means re-cook
+struct CookKey
+{
+    static constexpr uint32_t kCompressTextures = 1;
+
+    std::string sourcePath;
+    FileStamp sourceStamp;
+    uint64_t sourceHash = 0; // needed for writing; reading hashes the source only if its stamp changed
+    uint32_t importFlags = 0;
+    uint32_t cookFlags = 0; // kCompressTextures
+};
+
+// Read-only view of a whole file; mmap where available, otherwise read into memory
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    const uint8_t *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> buffer_;
+};
+
+// FNV-1a over the file's bytes; false if it cannot be read
+bool hashFile(const std::string &path, uint64_t &out);
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Parse a mapped cooked file. Fails (and leaves `out` empty) on a bad header,
+// a key mismatch, a record that points outside the file or its tables (index
+// blobs too short for their count, texture or material indices out of range),
+// or a dependency whose contents changed. Files whose stamp
+// still matches the recorded one are trusted without reading them.
+bool readCookedModel(const MappedFile &file, const CookKey &key, CookedModel &out);
+bool writeCookedModel(const std::string &path, const CookKey &key, const CookedModel &model);
+
+// Decode an encoded image (PNG, JPEG, ...) with stb_image and cook its mips.
+// Grey and grey+alpha images are expanded so every texture is RGB8 or RGBA8;
+// with `compress` the finished levels are then block compressed for `usage`.
+bool cookImage(CookedModel &model, CookedTexture &tex, const uint8_t *encoded, size_t size, TextureUsage usage, bool compress);
+
+// One channel of a packed texture: `channel` of an encoded image, or `fill` when there is none
+struct PackedChannel
+{
+    const uint8_t *encoded = nullptr;
+    size_t size = 0;
+    int channel = 0;
+    uint8_t fill = 255;
+};
+// Build one linear texture of `count` channels (1 for TextureUsage::Mask, 2 for
+// Data) from single-channel sources, e.g. occlusion, or split roughness and
+// metalness maps into one RG texture.
+bool cookPackedImage(CookedModel &model, CookedTexture &tex, const PackedChannel *channels, int count, TextureUsage usage, bool compress);
+// Box-filter mip chain for 8-bit pixels of 1-4 channels, filtered in linear space when srgb;
+// with renormalize each texel is treated as a unit vector (normal maps).
+// Appends every level (including level 0) to `tex`, storing pixel memory in `model`.
+void cookTextureMips(CookedModel &model, CookedTexture &tex, const uint8_t *pixels, int width, int height, int channels, bool srgb,
+                     bool renormalize = false);
+// Replace the uncompressed levels of `tex` with BC1/BC3/BC4/BC5 blocks chosen by usage
+void compressTextureMips(CookedModel &model, CookedTexture &tex, TextureUsage usage);
@@ -0,0 +1,273 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+struct ThreadBuffer
+{
+    struct Event
+    {
+        const char *name;
+        uint64_t begin, end;
+    };
+    Event events[Profiler::kThreadCapacity];
+    std::atomic<uint64_t> written{0};
+    std::atomic<const char *> name{nullptr};
+    int tid = 0;
+    bool inUse = false; // guarded by the registry mutex
+};
+
+// Buffers outlive their threads so finished threads still show in the trace;
+// a thread started later takes over a released buffer (and its track) instead
+// of adding one, which keeps per-call worker pools from growing the registry.
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+// Leaked: thread_local destructors may run after static destruction
+Registry &registry()
+{
+    static Registry *r = new Registry;
+    return *r;
+}
+
+// Timeline origin, and with a second sample at export the TSC rate
+const uint64_t g_epochTick = Profiler::now();
+const std::chrono::steady_clock::time_point g_epochTime = std::chrono::steady_clock::now();
+
+ThreadBuffer *acquireBuffer()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto &b : r.buffers)
+    {
+        if (!b->inUse)
+        {
+            b->inUse = true;
+            b->name.store(nullptr, std::memory_order_relaxed);
+            return b.get();
+        }
+    }
+    r.buffers.push_back(std::make_unique<ThreadBuffer>());
+    ThreadBuffer *b = r.buffers.back().get();
+    b->tid = (int)r.buffers.size();
+    b->inUse = true;
+    return b;
+}
+
+struct ThreadSlot
+{
+    ThreadBuffer *buffer = nullptr;
+    ~ThreadSlot()
+    {
+        if (!buffer)
+            return;
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        buffer->inUse = false;
+    }
+};
+thread_local ThreadSlot t_slot;
+// Trivial, so the hot path skips the TLS init guard t_slot's destructor brings
+thread_local ThreadBuffer *t_buffer = nullptr;
+
+ThreadBuffer &threadBuffer()
+{
+    if (!t_buffer)
+        t_buffer = t_slot.buffer = acquireBuffer();
+    return *t_buffer;
+}
+
+void writeJsonString(std::FILE *f, const char *s)
+{
+    std::fputc('"', f);
+    for (; s && *s; ++s)
+    {
+        if (*s == '"' || *s == '\\')
+            std::fputc('\\', f);
+        if ((unsigned char)*s >= 0x20)
+            std::fputc(*s, f);
+    }
+    std::fputc('"', f);
+}
+} // namespace
+
+Profiler &profiler()
+{
+    static Profiler p;
+    return p;
+}
+
+void Profiler::record(const char *name, uint64_t begin, uint64_t end)
+{
+    ThreadBuffer &b = threadBuffer();
+    // only this thread writes `written`; the release publishes the slot to writeChromeTrace
+    const uint64_t w = b.written.load(std::memory_order_relaxed);
+    b.events[w & (kThreadCapacity - 1)] = {name, begin, end};
+    b.written.store(w + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const char *name)
+{
+    threadBuffer().name.store(name, std::memory_order_relaxed);
+}
+
+void Profiler::beginGpuFrame()
+{
+    gpuFrame_ = (gpuFrame_ + 1) & 1;
+    collect(gpuFrames_[gpuFrame_]);
+}
+
+int Profiler::beginGpuZone(const char *name)
+{
+    if (gpuFrame_ < 0)
+        return -1;
+    GpuFrame &f = gpuFrames_[gpuFrame_];
+    if (f.usedQueries + 2 > f.queries.size())
+    {
+        const size_t first = f.queries.size();
+        f.queries.resize(first + 16);
+        glGenQueries(16, f.queries.data() + first);
+    }
+    glQueryCounter(f.queries[f.usedQueries], GL_TIMESTAMP);
+    f.zones.push_back({name, (int)f.usedQueries, -1});
+    f.usedQueries += 2;
+    return (int)f.zones.size() - 1;
+}
+
+void Profiler::endGpuZone(int zone)
+{
+    if (zone < 0 || gpuFrame_ < 0)
+        return;
+    GpuFrame &f = gpuFrames_[gpuFrame_];
+    if (zone >= (int)f.zones.size())
+        return; // opened before beginGpuFrame()
+    GpuZone &z = f.zones[zone];
+    z.endQuery = z.beginQuery + 1;
+    glQueryCounter(f.queries[z.endQuery], GL_TIMESTAMP);
+}
+
+void Profiler::collect(GpuFrame &frame)
+{
+    if (frame.zones.empty())
+        return;
+    // GL_TIMESTAMP is the GPU clock once prior commands reach the server,
+    // which is close enough to now() to line the two timelines up
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    const uint64_t tick = now();
+    for (const GpuZone &z : frame.zones)
+    {
+        if (z.endQuery < 0)
+            continue;
+        GLuint64 begin = 0, end = 0;
+        // issued two frames ago: normally long finished
+        glGetQueryObjectui64v(frame.queries[z.beginQuery], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[z.endQuery], GL_QUERY_RESULT, &end);
+        GpuEvent e{z.name, tick, (int64_t)begin - (int64_t)gpuNow, end > begin ? end - begin : 0};
+        if (gpuEvents_.size() < kGpuCapacity)
+            gpuEvents_.push_back(e);
+        else
+            gpuEvents_[gpuEventsWritten_ % kGpuCapacity] = e;
+        ++gpuEventsWritten_;
+    }
+    frame.zones.clear();
+    frame.usedQueries = 0;
+}
+
+void Profiler::shutdownGpu()
+{
+    if (gpuFrame_ >= 0)
+    {
+        // older frame first
+        collect(gpuFrames_[(gpuFrame_ + 1) & 1]);
+        collect(gpuFrames_[gpuFrame_]);
+    }
+    for (GpuFrame &f : gpuFrames_)
+    {
+        if (!f.queries.empty())
+            glDeleteQueries((GLsizei)f.queries.size(), f.queries.data());
+        f = GpuFrame{};
+    }
+    gpuFrame_ = -1;
+}
+
+bool Profiler::writeChromeTrace(const std::string &path)
+{
+    std::FILE *f = std::fopen(path.c_str(), "w");
+    if (!f)
+    {
+        std::fprintf(stderr, "Profiler: cannot write %s\n", path.c_str());
+        return false;
+    }
+#ifdef QOOM_PROFILER_TSC
+    const uint64_t tick = now();
+    const double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - g_epochTime).count();
+    const double nsPerTick = tick > g_epochTick ? elapsedNs / (double)(tick - g_epochTick) : 1.0;
+#else
+    const double nsPerTick = 1.0;
+#endif
+    auto toUs = [&](uint64_t t) { return (double)(int64_t)(t - g_epochTick) * nsPerTick * 1e-3; };
+
+    std::fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    std::fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"qoom\"}},\n");
+    std::fprintf(f, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"GPU\"}}");
+    size_t zones = 0;
+
+    std::vector<ThreadBuffer *> buffers;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        for (auto &b : registry().buffers)
+            buffers.push_back(b.get());
+    }
+    std::vector<ThreadBuffer::Event> events;
+    for (ThreadBuffer *b : buffers)
+    {
+        // Copy without stopping the writer, then drop whatever it may have
+        // overwritten meanwhile (including the slot it is writing now)
+        const uint64_t written = b->written.load(std::memory_order_acquire);
+        uint64_t first = written > kThreadCapacity ? written - kThreadCapacity : 0;
+        events.clear();
+        for (uint64_t i = first; i < written; ++i)
+            events.push_back(b->events[i & (kThreadCapacity - 1)]);
+        const uint64_t after = b->written.load(std::memory_order_acquire);
+        const uint64_t overwritten = after + 1 > kThreadCapacity ? after + 1 - kThreadCapacity : 0;
+        const size_t skip = (size_t)(std::max(first, overwritten) - first);
+
+        const char *name = b->name.load(std::memory_order_relaxed);
+        std::fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", b->tid);
+        if (name)
+            writeJsonString(f, name);
+        else
+            std::fprintf(f, "\"thread %d\"", b->tid);
+        std::fprintf(f, "}}");
+        for (size_t i = std::min(skip, events.size()); i < events.size(); ++i)
+        {
+            const ThreadBuffer::Event &e = events[i];
+            std::fprintf(f, ",\n{\"name\": ");
+            writeJsonString(f, e.name);
+            std::fprintf(f, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", b->tid, toUs(e.begin),
+                         (double)(e.end - e.begin) * nsPerTick * 1e-3);
+            ++zones;
+        }
+    }
+    for (const GpuEvent &e : gpuEvents_)
+    {
+        std::fprintf(f, ",\n{\"name\": ");
+        writeJsonString(f, e.name);
+        std::fprintf(f, ", \"ph\": \"X\", \"pid\": 1, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f}", toUs(e.syncTick) + (double)e.beginNs * 1e-3,
+                     (double)e.durationNs * 1e-3);
+        ++zones;
+    }
+    std::fprintf(f, "\n]}\n");
+    const bool ok = std::ferror(f) == 0;
+    std::fclose(f);
+    std::fprintf(stderr, "Profiler: %zu zones from %zu threads -> %s\n", zones, buffers.size(), path.c_str());
+    return ok;
+}
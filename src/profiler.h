@@ -0,0 +1,140 @@
+#pragma once
+#include <glad/gl.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define QOOM_PROFILER_TSC 1
+#else
+#include <chrono>
+#endif
+
+// Scoped CPU/GPU zones, exported in Chrome's trace_event JSON format
+// (chrome://tracing, ui.perfetto.dev).
+//
+//   PROFILE_SCOPE("name")      CPU time of the enclosing scope, any thread
+//   PROFILE_GPU_SCOPE("name")  the same plus GPU timestamps around it (GL thread)
+//   PROFILE_THREAD("name")     label the calling thread's track
+//   PROFILE_GPU_FRAME()        once per frame on the GL thread, before any GPU zone
+//
+// Names must be string literals (or otherwise outlive the profiler): only the
+// pointer is stored. Each thread writes into its own ring buffer without locks;
+// the newest kThreadCapacity zones per thread are kept. GPU zones use
+// glQueryCounter timestamps in two sets of queries that alternate per frame, so
+// a frame's results are read when its set comes round again, two frames on.
+//
+// Building with QOOM_PROFILER=0 turns the macros into nothing.
+#ifndef QOOM_PROFILER
+#define QOOM_PROFILER 1
+#endif
+
+class Profiler
+{
+public:
+    static constexpr bool kEnabled = QOOM_PROFILER != 0;
+    static constexpr size_t kThreadCapacity = 1u << 15; // zones per thread
+    static constexpr size_t kGpuCapacity = 1u << 14;    // collected GPU zones
+    static_assert((kThreadCapacity & (kThreadCapacity - 1)) == 0, "ring index is masked");
+
+    // Raw CPU timestamp: TSC ticks on x86, nanoseconds elsewhere
+    static uint64_t now()
+    {
+#ifdef QOOM_PROFILER_TSC
+        return __rdtsc();
+#else
+        return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    // Appends a finished zone to the calling thread's ring buffer
+    static void record(const char *name, uint64_t begin, uint64_t end);
+    static void setThreadName(const char *name);
+
+    // GL thread only. Collects the zones issued two frames ago and starts a new
+    // frame; GPU zones outside a frame are dropped.
+    void beginGpuFrame();
+    // Returns the zone's index, or -1 outside a frame
+    int beginGpuZone(const char *name);
+    void endGpuZone(int zone);
+    // Waits for every GPU zone in flight and releases the queries; call before the context goes
+    void shutdownGpu();
+
+    // Snapshot of every thread's buffer, safe while other threads keep
+    // recording; GPU zones make it GL thread only
+    bool writeChromeTrace(const std::string &path);
+
+private:
+    struct GpuZone
+    {
+        const char *name;
+        int beginQuery, endQuery;
+    };
+    struct GpuFrame
+    {
+        std::vector<GLuint> queries;
+        size_t usedQueries = 0;
+        std::vector<GpuZone> zones;
+    };
+    // A collected GPU zone on the CPU timeline: GPU nanoseconds relative to a
+    // CPU/GPU clock pair sampled at collection
+    struct GpuEvent
+    {
+        const char *name;
+        uint64_t syncTick;
+        int64_t beginNs;
+        uint64_t durationNs;
+    };
+    void collect(GpuFrame &frame);
+
+    GpuFrame gpuFrames_[2];
+    int gpuFrame_ = -1;
+    std::vector<GpuEvent> gpuEvents_; // ring of kGpuCapacity
+    uint64_t gpuEventsWritten_ = 0;
+};
+
+Profiler &profiler();
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char *name) : name_(name), begin_(Profiler::now()) {}
+    ~ProfileZone() { Profiler::record(name_, begin_, Profiler::now()); }
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+    const char *name_;
+    uint64_t begin_;
+};
+
+class ProfileGpuZone
+{
+public:
+    explicit ProfileGpuZone(const char *name) : cpu_(name), gpu_(profiler().beginGpuZone(name)) {}
+    ~ProfileGpuZone() { profiler().endGpuZone(gpu_); }
+    ProfileGpuZone(const ProfileGpuZone &) = delete;
+    ProfileGpuZone &operator=(const ProfileGpuZone &) = delete;
+
+private:
+    ProfileZone cpu_;
+    int gpu_;
+};
+
+#define QOOM_PROFILE_CAT2(a, b) a##b
+#define QOOM_PROFILE_CAT(a, b) QOOM_PROFILE_CAT2(a, b)
+#if QOOM_PROFILER
+#define PROFILE_SCOPE(name) ProfileZone QOOM_PROFILE_CAT(profileZone_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) ProfileGpuZone QOOM_PROFILE_CAT(profileZone_, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#define PROFILE_GPU_FRAME() profiler().beginGpuFrame()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_GPU_FRAME() ((void)0)
+#endif
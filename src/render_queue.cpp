@@ -0,0 +1,47 @@
+#include "render_queue.h"
+#include <algorithm>
+
+uint32_t RenderQueue::quantizeDepth(float distance, float maxDistance)
+{
+    if (!(distance > 0.0f) || maxDistance <= 0.0f)
+        return 0;
+    float t = std::min(distance / maxDistance, 1.0f);
+    return (uint32_t)(t * (float)0xFFFFF);
+}
+
+void RenderQueue::sort()
+{
+    const size_t n = items_.size();
+    if (n < 2)
+        return;
+    scratch_.resize(n);
+
+    // All eight histograms in one read of the keys
+    uint32_t counts[8][256] = {};
+    for (const Item &it : items_)
+        for (int b = 0; b < 8; ++b)
+            ++counts[b][(it.key >> (b * 8)) & 0xFF];
+
+    Item *src = items_.data();
+    Item *dst = scratch_.data();
+    for (int b = 0; b < 8; ++b)
+    {
+        uint32_t *c = counts[b];
+        const int shift = b * 8;
+        // a byte shared by every key leaves the order unchanged
+        if (c[(src[0].key >> shift) & 0xFF] == n)
+            continue;
+        uint32_t sum = 0;
+        for (int d = 0; d < 256; ++d)
+        {
+            uint32_t k = c[d];
+            c[d] = sum;
+            sum += k;
+        }
+        for (size_t i = 0; i < n; ++i)
+            dst[c[(src[i].key >> shift) & 0xFF]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != items_.data())
+        items_.swap(scratch_);
+}
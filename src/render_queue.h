@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draw items ordered by a 64-bit sort key so consecutive draws share as much
+// GL state as possible. Key layout, most significant first:
+//   pass (4) | program variant (8) | material (16) | mesh (16) | depth (20)
+// Fields only order the queue; each item's payload index says what to draw, so
+// ids that alias in a field cost a state change, never a wrong draw.
+class RenderQueue
+{
+public:
+    struct Item
+    {
+        uint64_t key;
+        uint32_t payload;
+    };
+
+    static uint64_t makeKey(uint32_t pass, uint32_t variant, uint32_t material, uint32_t mesh, uint32_t depth)
+    {
+        return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(variant & 0xFF) << 52) | ((uint64_t)(material & 0xFFFF) << 36) |
+               ((uint64_t)(mesh & 0xFFFF) << 20) | (uint64_t)(depth & 0xFFFFF);
+    }
+    // Map a view distance in [0, maxDistance] to the depth field (near first)
+    static uint32_t quantizeDepth(float distance, float maxDistance);
+
+    void clear() { items_.clear(); }
+    void push(uint64_t key, uint32_t payload) { items_.push_back({key, payload}); }
+    // LSD radix sort on the key, 8 bits per pass; passes where every key has the same byte are skipped
+    void sort();
+
+    const std::vector<Item> &items() const { return items_; }
+    size_t size() const { return items_.size(); }
+
+private:
+    std::vector<Item> items_;
+    std::vector<Item> scratch_;
+};
@@ -1,54 +1,142 @@
 #include "renderer.h"
 #include "shader.h"
+#include "gl_state.h"
 #include "assimp_model.h"
 #include "environment.h"
+#include "model_cache.h"
+#include "texture_streamer.h"
+#include "profiler.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include "level.h"
 #include "voxel_world.h"
-#include <stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+
+// Development builds read shaders from the source tree so hot reload sees the
+// files being edited (CMake option QOOM_SHADERS_FROM_SOURCE)
+#ifndef QOOM_SHADER_DIR
+#define QOOM_SHADER_DIR "shaders"
+#endif
+
+namespace
+{
+// std140 mirror of the FrameUniforms block in shaders/frame_uniforms.glsl
+struct FrameUniforms
+{
+    glm::mat4 viewProj;
+    glm::mat4 lightVP[4];
+    glm::mat4 cameraBasis;
+    glm::vec4 cameraPos;
+    glm::vec4 lightDir;
+    glm::vec4 lightColor;
+    glm::vec4 ambientColor;
+    glm::vec4 envStrength;
+    glm::vec4 cascadeSplits;
+    glm::vec4 envSH[9];
+};
+static_assert(sizeof(FrameUniforms) == 6 * 64 + 15 * 16, "FrameUniforms must match std140 layout");
+const GLuint kFrameUniformBinding = 0;
+
+const int kCascadeSize = 2048;        // texels per side of each cascade layer
+const float kShadowDistance = 96.0f;  // view depth covered by the cascades
+const float kSplitLambda = 0.75f;     // blend of logarithmic (1) and uniform (0) splits
+const float kCasterReach = 64.0f;     // casters this far towards the light still land in a cascade
+// Cascades from here on are cached: fitted with slack and only redrawn when the
+// light, the static geometry, or the camera leaving the slack invalidates them
+const int kFirstCachedCascade = 2;
+// pbr variants: the voxel surface box-projects its grid texture, meshes add
+// their material's texture bits. Both force roughness (see flushQueue).
+const uint32_t kVoxelFeatures = kPbrBoxUV | kPbrOverrideRoughness;
+const uint32_t kMeshFeatures = kPbrOverrideRoughness;
+const float kCachedCascadeSlack = 1.3f;
+
+// The source tree when it is still there, else the copy next to the binary
+std::string shaderDir()
+{
+    std::error_code ec;
+    return std::filesystem::is_directory(QOOM_SHADER_DIR, ec) ? QOOM_SHADER_DIR : "shaders";
+}
+}
 
 Renderer::Renderer() {}
 Renderer::~Renderer()
 {
+    GLState &gs = glState();
     if (shadowTex_)
+    {
+        gs.forgetTexture(shadowTex_);
         glDeleteTextures(1, &shadowTex_);
-    if (shadowFBO_)
-        glDeleteFramebuffers(1, &shadowFBO_);
+    }
+    for (GLuint fbo : shadowFBO_)
+        gs.forgetFramebuffer(fbo);
+    if (shadowFBO_[0])
+        glDeleteFramebuffers(kCascadeCount, shadowFBO_);
     if (screenVAO_)
+    {
+        gs.forgetVertexArray(screenVAO_);
         glDeleteVertexArrays(1, &screenVAO_);
+    }
     if (voxelEBO_)
         glDeleteBuffers(1, &voxelEBO_);
     if (voxelVBO_)
         glDeleteBuffers(1, &voxelVBO_);
     if (voxelVAO_)
+    {
+        gs.forgetVertexArray(voxelVAO_);
         glDeleteVertexArrays(1, &voxelVAO_);
+    }
+    if (voxelMeshEBO_)
+        glDeleteBuffers(1, &voxelMeshEBO_);
+    if (voxelMeshVBO_)
+        glDeleteBuffers(1, &voxelMeshVBO_);
+    if (voxelMeshVAO_)
+    {
+        gs.forgetVertexArray(voxelMeshVAO_);
+        glDeleteVertexArrays(1, &voxelMeshVAO_);
+    }
     if (gridTex_)
+    {
+        textureStreamer().cancel(gridTex_);
+        gs.forgetTexture(gridTex_);
         glDeleteTextures(1, &gridTex_);
+    }
+    if (frameUBO_)
+        glDeleteBuffers(1, &frameUBO_);
     delete sky_;
     delete pbr_;
     delete shadow_;
+    delete debug_;
 }
 
 bool Renderer::init()
 {
-    glEnable(GL_DEPTH_TEST);
+    glState().invalidate();
+    glState().setEnabled(GL_DEPTH_TEST, true);
     glEnable(GL_FRAMEBUFFER_SRGB);
-    glEnable(GL_BLEND);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); // filter across environment cube faces
+    glState().setEnabled(GL_BLEND, true);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glGenVertexArrays(1, &screenVAO_);
+    if (GLAD_GL_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu); // hot reloads link off the GL thread
 
     sky_ = new ShaderProgram();
-    pbr_ = new ShaderProgram();
+    pbr_ = new ShaderVariants();
     shadow_ = new ShaderProgram();
     debug_ = new ShaderProgram();
+    const std::string dir = shaderDir();
+    std::fprintf(stderr, "Renderer: shaders from %s\n", dir.c_str());
     std::string log;
-    if (!sky_->loadFromFiles("shaders/env_sky.vert", "shaders/env_sky.frag", &log))
-        return false;
-    log.clear();
-    if (!pbr_->loadFromFiles("shaders/pbr.vert", "shaders/pbr.frag", &log))
+    if (!sky_->loadFromFiles(dir + "/env_sky.vert", dir + "/env_sky.frag", &log))
         return false;
     log.clear();
-    if (!shadow_->loadFromFiles("shaders/shadow.vert", "shaders/shadow.frag", &log))
+    pbr_->init(dir + "/pbr.vert", dir + "/pbr.frag", std::vector<std::string>(std::begin(kPbrFeatureNames), std::end(kPbrFeatureNames)));
+    if (!shadow_->loadFromFiles(dir + "/shadow.vert", dir + "/shadow.frag", &log))
         return false;
     // Minimal debug shader (inline)
     const char* dbg_vs = R"(#version 330 core
@@ -60,230 +148,569 @@ void main(){ gl_Position = uMVP * vec4(aPos,1.0); }
 out vec4 FragColor; uniform vec3 uColor; void main(){ FragColor = vec4(uColor,1.0); }
 )";
     if (!debug_->loadFromSource(dbg_vs, dbg_fs, &log)) return false;
+
+    glGenBuffers(1, &frameUBO_);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kFrameUniformBinding, frameUBO_);
+    configurePrograms();
+    // variants every frame can draw; models prewarm their own
+    if (!pbrVariant(kVoxelFeatures) || !pbrVariant(kMeshFeatures))
+        return false;
+    shaderWatcher_.start(dir);
+
+    InstanceData identity = InstanceData::fromMatrix(glm::mat4(1.0f));
+    identityInstances_.upload(&identity, 1);
     return initShadow();
 }
 
+void Renderer::configurePrograms()
+{
+    for (ShaderProgram *p : {shadow_, sky_})
+        p->bindUniformBlock("FrameUniforms", kFrameUniformBinding);
+    for (const auto &v : pbr_->variants())
+        if (v.second)
+            configurePbr(*v.second);
+
+    // Sampler units are program state; assign them once per link
+    sky_->use();
+    sky_->set1i("uEnvMap", 0);
+
+    shadowCascadeU_ = shadow_->uniform("uCascade");
+    shadowMaterialU_ = AMaterialUniforms::resolve(*shadow_);
+    debugMVPU_ = debug_->uniform("uMVP");
+    debugColorU_ = debug_->uniform("uColor");
+}
+
+void Renderer::configurePbr(ShaderProgram &program)
+{
+    program.bindUniformBlock("FrameUniforms", kFrameUniformBinding);
+    program.use();
+    program.set1i("uBaseColorTex", 0);
+    program.set1i("uRoughMetalTex", 1);
+    program.set1i("uNormalTex", 2);
+    program.set1i("uShadowMap", 3);
+    program.set1i("uEnvSpecular", 4);
+    program.set1i("uBrdfLut", 5);
+    program.set1i("uOcclusionTex", 6);
+}
+
+ShaderProgram *Renderer::pbrVariant(uint32_t features)
+{
+    bool created = false;
+    ShaderProgram *p = pbr_->get(features, &created);
+    if (created)
+        configurePbr(*p);
+    return p;
+}
+
+void Renderer::prewarm(const AssimpModel &model)
+{
+    prewarmed_.insert(&model);
+    for (const auto &prim : model.primitives())
+        pbrVariant(kMeshFeatures | model.materialFeatures(prim.materialIndex));
+}
+
+void Renderer::reloadChangedShaders()
+{
+    std::vector<ShaderProgram *> programs = {sky_, shadow_};
+    for (const auto &v : pbr_->variants())
+        if (v.second)
+            programs.push_back(v.second.get());
+    for (const std::string &name : shaderWatcher_.takeChanged())
+    {
+        if (pbr_->usesFile(name))
+            pbr_->retryFailed(); // variants that did not build may now
+        for (ShaderProgram *p : programs)
+        {
+            std::string log;
+            if (p->usesFile(name) && !p->startReload(&log))
+                std::fprintf(stderr, "Shader reload: %s", log.c_str());
+        }
+    }
+    bool swapped = false;
+    for (ShaderProgram *p : programs)
+    {
+        std::string log;
+        ShaderProgram::ReloadStatus status = p->pollReload(&log);
+        swapped |= status == ShaderProgram::ReloadStatus::Swapped;
+        if (status == ShaderProgram::ReloadStatus::Failed)
+            std::fprintf(stderr, "Shader reload failed, keeping the previous program: %s\n", log.c_str());
+    }
+    if (swapped)
+    {
+        configurePrograms();
+        // the shadow program may have changed: cached cascades redraw
+        for (int i = kFirstCachedCascade; i < kCascadeCount; ++i)
+            cascades_[i].valid = false;
+        std::fprintf(stderr, "Shader reload: programs swapped\n");
+    }
+}
+
 bool Renderer::initShadow()
 {
-    const int SHADOW_SIZE = 4096;
-    glGenFramebuffers(1, &shadowFBO_);
     glGenTextures(1, &shadowTex_);
-    glBindTexture(GL_TEXTURE_2D, shadowTex_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SHADOW_SIZE, SHADOW_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glState().bindTextureForUpdate(GL_TEXTURE_2D_ARRAY, shadowTex_);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, kCascadeSize, kCascadeSize, kCascadeCount, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     float borderColor[4] = {1.f, 1.f, 1.f, 1.f};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO_);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowTex_, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    // one framebuffer per layer so switching cascades is a tracked bind, not a re-attach
+    glGenFramebuffers(kCascadeCount, shadowFBO_);
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        glState().bindFramebuffer(shadowFBO_[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowTex_, 0, i);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    glState().bindFramebuffer(0);
     return true;
 }
 
-void Renderer::drawColliders(const std::vector<AABB>& colliders){
-    if (!voxelVAO_) ensureVoxelResources();
-    if (!voxelVAO_) return;
-    if (screenW_ > 0 && screenH_ > 0) glViewport(0,0,screenW_,screenH_);
-    glDisable(GL_CULL_FACE);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    debug_->use();
-    GLint locColor = glGetUniformLocation(debug_->id(), "uColor");
-    glUniform3f(locColor, 1.0f, 0.1f, 0.1f);
-    glBindVertexArray(voxelVAO_);
-    for (const auto& b : colliders){
-        glm::vec3 center = (b.min + b.max) * 0.5f;
-        glm::vec3 size = (b.max - b.min);
-        glm::mat4 M(1.0f);
-        M = glm::translate(M, center);
-        M = glm::scale(M, size);
-        glm::mat4 MVP = proj_ * view_ * M;
-        debug_->setMatrix4("uMVP", &MVP[0][0]);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-    }
-    glBindVertexArray(0);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+void Renderer::setEnvironment(const EnvironmentMap *env)
+{
+    env_ = env;
+    frameDirty_ = true; // IBL terms live in the frame uniforms
 }
-
-void Renderer::setEnvironment(const EnvironmentMap *env) { env_ = env; }
 void Renderer::setCamera(const glm::mat4 &proj, const glm::mat4 &view, const glm::vec3 &camPos)
 {
     proj_ = proj;
     view_ = view;
     camPos_ = camPos;
+    frameDirty_ = true;
+}
+void Renderer::setLightDir(const glm::vec3 &dir)
+{
+    if (dir == lightDir_)
+        return;
+    lightDir_ = dir;
+    frameDirty_ = true;
+    for (auto &c : cascades_)
+        c.valid = false;
+}
+
+void Renderer::updateFrameUniforms()
+{
+    if (!frameDirty_)
+        return;
+    fitCascades();
+
+    FrameUniforms fu;
+    fu.viewProj = proj_ * view_;
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        fu.lightVP[i] = cascades_[i].viewProj;
+        fu.cascadeSplits[i] = cascades_[i].splitFar;
+    }
+    cameraFrustum_ = Frustum::fromMatrix(fu.viewProj);
+    // camera basis from view matrix (columns of inverse view)
+    fu.cameraBasis = glm::mat4(
+        glm::vec4(view_[0][0], view_[1][0], view_[2][0], 0.0f),
+        glm::vec4(view_[0][1], view_[1][1], view_[2][1], 0.0f),
+        -glm::vec4(view_[0][2], view_[1][2], view_[2][2], 0.0f),
+        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    fu.cameraPos = glm::vec4(camPos_, 1.0f);
+    fu.lightDir = glm::vec4(lightDir_, 0.0f);
+    fu.lightColor = glm::vec4(5.0f, 5.0f, 5.0f, 0.0f);
+    fu.ambientColor = glm::vec4(0.05f, 0.05f, 0.05f, 0.0f);
+    const bool hasEnv = env_ && env_->id();
+    fu.envStrength = glm::vec4(1.0f, 1.0f, hasEnv ? env_->maxSpecularLod() : 0.0f, 0.0f);
+    const float *sh = hasEnv ? env_->irradianceSH() : nullptr;
+    for (int i = 0; i < 9; ++i)
+        fu.envSH[i] = sh ? glm::vec4(sh[4 * i], sh[4 * i + 1], sh[4 * i + 2], 0.0f) : glm::vec4(0.0f);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO_);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &fu);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    frameDirty_ = false;
+}
+
+void Renderer::fitCascades()
+{
+    // near/far and field of view back out of the perspective matrix
+    const float camNear = proj_[3][2] / (proj_[2][2] - 1.0f);
+    const float camFar = proj_[3][2] / (proj_[2][2] + 1.0f);
+    viewFar_ = camFar;
+    const float tanY = 1.0f / proj_[1][1];
+    const float tanX = 1.0f / proj_[0][0];
+    const float shadowFar = std::min(camFar, kShadowDistance);
+    const glm::vec3 right(view_[0][0], view_[1][0], view_[2][0]);
+    const glm::vec3 up(view_[0][1], view_[1][1], view_[2][1]);
+    const glm::vec3 fwd(-view_[0][2], -view_[1][2], -view_[2][2]);
+
+    glm::vec3 lightUp = std::fabs(lightDir_.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+    glm::mat4 lightRot = glm::lookAt(glm::vec3(0.0f), lightDir_, lightUp);
+
+    float splitNear = camNear;
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        ShadowCascade &c = cascades_[i];
+        float t = float(i + 1) / float(kCascadeCount);
+        float logSplit = camNear * std::pow(shadowFar / camNear, t);
+        float linSplit = camNear + (shadowFar - camNear) * t;
+        float splitFar = kSplitLambda * logSplit + (1.0f - kSplitLambda) * linSplit;
+
+        // bounding sphere of the slice: its size does not change as the camera turns
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int k = 0; k < 8; ++k)
+        {
+            float d = (k & 4) ? splitFar : splitNear;
+            corners[k] = camPos_ + fwd * d + right * (((k & 1) ? 1.0f : -1.0f) * d * tanX) + up * (((k & 2) ? 1.0f : -1.0f) * d * tanY);
+            center += corners[k];
+        }
+        center *= 1.0f / 8.0f;
+        float radius = 0.0f;
+        for (const auto &p : corners)
+            radius = std::max(radius, glm::length(p - center));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+        glm::vec3 centerLS = glm::vec3(lightRot * glm::vec4(center, 1.0f));
+        c.splitFar = splitFar;
+        splitNear = splitFar;
+
+        const bool cached = i >= kFirstCachedCascade;
+        if (cached && c.valid)
+        {
+            glm::vec3 d = glm::abs(centerLS - c.centerLS);
+            if (std::max(d.x, std::max(d.y, d.z)) + radius <= c.radius)
+                continue; // previous fit still covers the slice
+        }
+
+        // snap the center to whole texels so static shadows do not shimmer as the camera moves
+        float r = cached ? radius * kCachedCascadeSlack : radius;
+        float texel = 2.0f * r / float(kCascadeSize);
+        centerLS.x = std::floor(centerLS.x / texel) * texel;
+        centerLS.y = std::floor(centerLS.y / texel) * texel;
+        glm::mat4 lightProj = glm::ortho(centerLS.x - r, centerLS.x + r, centerLS.y - r, centerLS.y + r,
+                                         -centerLS.z - r - kCasterReach, -centerLS.z + r);
+        c.viewProj = lightProj * lightRot;
+        c.frustum = Frustum::fromMatrix(c.viewProj);
+        c.centerLS = centerLS;
+        c.radius = r;
+        c.valid = false;
+    }
+}
+
+void Renderer::beginFrame()
+{
+    PROFILE_GPU_FRAME();
+    PROFILE_SCOPE("Renderer::beginFrame");
+    reloadChangedShaders();
+    updateFrameUniforms();
+    modelDraws_.clear();
+    instancePoolUsed_ = 0;
+    voxelDraw_ = VoxelDraw{};
+    colliders_ = nullptr;
+}
+
+void Renderer::submitScene(const AssimpModel &model)
+{
+    if (!prewarmed_.count(&model))
+        prewarm(model);
+    modelDraws_.push_back({&model, nullptr, 0});
+}
+
+void Renderer::submitInstances(const AssimpModel &model, const std::vector<LevelInstance> &instances, uint64_t revision)
+{
+    if (!prewarmed_.count(&model))
+        prewarm(model);
+    // one stream per pass that may draw it: each shadow cascade, then the camera
+    ModelDraw d{&model, &instances, instancePoolUsed_, revision};
+    instancePoolUsed_ += kCascadeCount + 1;
+    while (instancePool_.size() < instancePoolUsed_)
+        instancePool_.push_back(std::make_unique<InstanceBuffer>());
+    modelDraws_.push_back(d);
+}
+
+void Renderer::submitVoxels(const VoxelWorld &world, float roughness, float uvTilesPerMeter)
+{
+    if (!ensureVoxelResources())
+        return;
+    syncVoxelMesh(world);
+    voxelDraw_.world = &world;
+    voxelDraw_.roughness = roughness;
+    voxelDraw_.uvTilesPerMeter = uvTilesPerMeter;
+}
+
+void Renderer::submitColliders(const std::vector<AABB> &colliders)
+{
+    if (!voxelVAO_)
+        ensureVoxelResources();
+    colliders_ = &colliders;
+}
+
+void Renderer::endFrame()
+{
+    PROFILE_SCOPE("Renderer::endFrame");
+    updateFrameUniforms();
+    graph_.reset();
+    graph_.setClearColor(glm::vec4(0.1f, 0.16f, 0.24f, 1.0f));
+    FrameGraph::Resource backbuffer = graph_.importTarget("backbuffer", outputFBO_, screenW_, screenH_);
+    graph_.markOutput(backbuffer);
+
+    // static geometry: models and instance lists that come, go or are edited
+    const uint64_t drawCount = modelDraws_.size();
+    uint64_t signature = hashBytes(&drawCount, sizeof(drawCount));
+    for (const ModelDraw &d : modelDraws_)
+    {
+        const uint64_t key[4] = {(uint64_t)(uintptr_t)d.model, (uint64_t)(uintptr_t)d.instances,
+                                 d.instances ? (uint64_t)d.instances->size() : 0, d.revision};
+        signature = hashBytes(key, sizeof(key), signature);
+    }
+    if (signature != sceneSignature_)
+    {
+        sceneSignature_ = signature;
+        for (int i = kFirstCachedCascade; i < kCascadeCount; ++i)
+            cascades_[i].valid = false;
+    }
+
+    // near cascades follow the camera every frame; cached ones only when invalidated
+    std::vector<FrameGraph::Resource> cascadeTargets;
+    for (int i = 0; i < kCascadeCount; ++i)
+    {
+        ShadowCascade &c = cascades_[i];
+        c.refresh = i < kFirstCachedCascade || !c.valid;
+        c.valid = true;
+        FrameGraph::Resource t = graph_.importTarget("shadow cascade", shadowFBO_[i], kCascadeSize, kCascadeSize);
+        cascadeTargets.push_back(t);
+        if (c.refresh)
+            graph_.addPass("shadow", t, GL_DEPTH_BUFFER_BIT, {}, [this, i] { shadowPass(i); });
+    }
+    graph_.addPass("opaque", backbuffer, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, cascadeTargets, [this] { opaquePass(); });
+    // after opaque so the depth test rejects every covered sky pixel
+    graph_.addPass("sky", backbuffer, 0, {}, [this] { drawSky(); });
+    if (colliders_ && voxelVAO_)
+        graph_.addPass("colliders", backbuffer, 0, {}, [this] { colliderPass(); });
+    graph_.execute();
 }
-void Renderer::setLightDir(const glm::vec3 &dir) { lightDir_ = dir; }
 
 void Renderer::drawSky()
 {
     if (!env_ || !env_->id() || !skyEnabled_)
         return;
-    glDisable(GL_DEPTH_TEST);
+    GLState &gs = glState();
+    // drawn at the far plane: passes only where nothing was written
+    gs.setEnabled(GL_DEPTH_TEST, true);
+    gs.depthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+    gs.setEnabled(GL_CULL_FACE, false);
+    gs.polygonMode(GL_FILL);
     sky_->use();
-    sky_->set1i("uEnvEquirect", 0);
-    // camera basis from view matrix (columns of inverse view)
-    glm::mat3 camBasis(
-        glm::vec3(view_[0][0], view_[1][0], view_[2][0]),
-        glm::vec3(view_[0][1], view_[1][1], view_[2][1]),
-        -glm::vec3(view_[0][2], view_[1][2], view_[2][2]));
-    glUniformMatrix3fv(glGetUniformLocation(sky_->id(), "uCameraBasis"), 1, GL_FALSE, &camBasis[0][0]);
     env_->bind(GL_TEXTURE0);
-    glBindVertexArray(screenVAO_);
+    gs.bindVertexArray(screenVAO_);
     glDrawArrays(GL_TRIANGLES, 0, 3);
-    glBindVertexArray(0);
-    glEnable(GL_DEPTH_TEST);
+    glDepthMask(GL_TRUE);
+    gs.depthFunc(GL_LESS);
 }
 
-void Renderer::drawScene(const AssimpModel &model)
+void Renderer::shadowPass(int cascade)
 {
-    // light matrices
-    glm::vec3 lightPos = -lightDir_ * 64.0f;
-    glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0, 1, 0));
-    glm::mat4 lightProj = glm::ortho(-32.0f, 32.0f, -32.0f, 32.0f, 1.0f, 128.0f);
-    glm::mat4 modelM(1.0f);
-    glm::mat4 lightMVP = lightProj * lightView * modelM;
-
-    // shadow pass
-    glViewport(0, 0, 4096, 4096);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO_);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glPolygonOffset(2.f, 4.f);
+    GLState &gs = glState();
+    gs.setEnabled(GL_DEPTH_TEST, true);
+    gs.setEnabled(GL_POLYGON_OFFSET_FILL, true);
+    gs.polygonOffset(2.f, 4.f);
+    gs.polygonMode(GL_FILL);
+    gs.setEnabled(GL_CULL_FACE, !dbgDisableCull_);
+    gs.cullFace(GL_FRONT);
     shadow_->use();
-    shadow_->setMatrix4("uLightMVP", &lightMVP[0][0]);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT);
-    model.draw(*shadow_);
-    glCullFace(GL_BACK);
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // scene pass
-    // Ensure we restore the viewport to the default framebuffer size
-    if (screenW_ > 0 && screenH_ > 0)
-        glViewport(0, 0, screenW_, screenH_);
-    glClearColor(0.1f, 0.16f, 0.24f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    drawSky();
-
-    glm::mat4 mvp = proj_ * view_ * modelM;
-    pbr_->use();
-    pbr_->setMatrix4("uMVP", &mvp[0][0]);
-    pbr_->setMatrix4("uModel", &modelM[0][0]);
-    glm::mat3 normalMat = glm::mat3(glm::transpose(glm::inverse(modelM)));
-    glUniformMatrix3fv(glGetUniformLocation(pbr_->id(), "uNormalMatrix"), 1, GL_FALSE, &normalMat[0][0]);
-    pbr_->setMatrix4("uLightMVP", &lightMVP[0][0]);
-    pbr_->set3f("uLightDir", lightDir_.x, lightDir_.y, lightDir_.z);
-    pbr_->set3f("uLightColor", 5.f, 5.f, 5.f);
-    pbr_->set3f("uAmbientColor", 0.05f, 0.05f, 0.05f);
-    pbr_->set1i("uBaseColorTex", 0);
-    pbr_->set1i("uORMTex", 1);
-    pbr_->set1i("uNormalTex", 2);
-    pbr_->set1i("uRoughnessTex", 5);
-    pbr_->set1i("uMetalnessTex", 6);
-    pbr_->set4f("uBaseColorFactor", 1.f, 1.f, 1.f, 1.f);
-    pbr_->set1i("uShadowMap", 3);
-    pbr_->set1i("uEnvEquirect", 4);
-    pbr_->set1i("uHasORM", 0);
-    pbr_->set1i("uHasNormal", 0);
-    pbr_->set1i("uHasRoughness", 0);
-    pbr_->set1i("uHasMetalness", 0);
-    pbr_->set3f("uCameraPos", camPos_.x, camPos_.y, camPos_.z);
-    pbr_->set1f("uEnvSpecStrength", 2.0f);
-    pbr_->set1f("uEnvDiffStrength", 1.0f);
-    pbr_->set1f("uOverrideRoughness", 0.25f);
-    pbr_->set1f("uOverrideMetallic", -1.0f);
-
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, shadowTex_);
+    shadow_->set1i(shadowCascadeU_, cascade);
+
+    beginQueue();
+    if (voxelDraw_.world)
+        queueVoxels(cascade);
+    for (size_t i = 0; i < modelDraws_.size(); ++i)
+        queueModel(modelDraws_[i], i, cascade);
+    flushQueue(true);
+}
+
+void Renderer::opaquePass()
+{
+    GLState &gs = glState();
+    gs.setEnabled(GL_POLYGON_OFFSET_FILL, false);
+    gs.setEnabled(GL_CULL_FACE, !dbgDisableCull_);
+    gs.cullFace(GL_BACK);
+    gs.setEnabled(GL_DEPTH_TEST, true);
+    gs.polygonMode(dbgWireframe_ ? GL_LINE : GL_FILL);
+    gs.bindTexture(3, GL_TEXTURE_2D_ARRAY, shadowTex_);
     if (env_ && env_->id())
     {
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, env_->id());
+        env_->bind(GL_TEXTURE4);
+        env_->bindBrdfLut(GL_TEXTURE5);
     }
+    beginQueue();
+    if (voxelDraw_.world)
+        queueVoxels(kCascadeCount);
+    for (size_t i = 0; i < modelDraws_.size(); ++i)
+        queueModel(modelDraws_[i], i, kCascadeCount);
+    flushQueue(false);
+}
 
-    model.draw(*pbr_);
+void Renderer::beginQueue()
+{
+    queue_.clear();
+    queued_.clear();
 }
 
-void Renderer::drawInstances(const AssimpModel &model, const std::vector<LevelInstance> &instances)
+void Renderer::queueVoxels(int pass)
 {
-    // light matrices
-    glm::vec3 lightPos = -lightDir_ * 64.0f;
-    glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0, 1, 0));
-    glm::mat4 lightProj = glm::ortho(-32.0f, 32.0f, -32.0f, 32.0f, 1.0f, 128.0f);
+    // one item: the chunk ranges are culled and merged when it is drawn
+    QueuedDraw q;
+    q.frustum = pass < kCascadeCount ? &cascades_[pass].frustum : &cameraFrustum_;
+    q.features = kVoxelFeatures;
+    // variant 0: the big occluder fills depth before the meshes
+    queue_.push(RenderQueue::makeKey(pass, 0, 0, 0, 0), (uint32_t)queued_.size());
+    queued_.push_back(q);
+}
 
-    // shadow pass per instance
-    glViewport(0, 0, 4096, 4096);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO_);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glPolygonOffset(2.f, 4.f);
-    shadow_->use();
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT);
+void Renderer::queueModel(const ModelDraw &d, size_t drawIndex, int pass)
+{
+    // pass < kCascadeCount: that shadow cascade; kCascadeCount: the camera
+    const bool shadow = pass < kCascadeCount;
+    const Frustum &frustum = shadow ? cascades_[pass].frustum : cameraFrustum_;
+    const AssimpModel &model = *d.model;
+    const auto &prims = model.primitives();
+    // material and mesh ids only need to be distinct within the frame's draws
+    auto push = [&](size_t prim, const InstanceBuffer &instances, float distance) {
+        uint32_t material = shadow ? 0u : (uint32_t)(((drawIndex + 1) << 8) | ((uint32_t)prims[prim].materialIndex & 0xFF));
+        uint32_t mesh = (uint32_t)((drawIndex << 10) | prim);
+        uint32_t depth = shadow ? 0u : RenderQueue::quantizeDepth(distance, viewFar_);
+        uint32_t features = kMeshFeatures | model.materialFeatures(prims[prim].materialIndex);
+        queue_.push(RenderQueue::makeKey(pass, shadow ? 1u : 1u + features, material, mesh, depth), (uint32_t)queued_.size());
+        QueuedDraw q;
+        q.model = &model;
+        q.instances = &instances;
+        q.primitive = (uint32_t)prim;
+        q.features = features;
+        queued_.push_back(q);
+    };
+    cullCenters_.clear();
+    cullExtents_.clear();
+
+    if (!d.instances)
+    {
+        // single identity instance: cull primitive by primitive
+        for (const auto &p : prims)
+        {
+            cullCenters_.push_back((p.boundsMin + p.boundsMax) * 0.5f);
+            cullExtents_.push_back((p.boundsMax - p.boundsMin) * 0.5f);
+        }
+        cullVisible_.resize(prims.size());
+        frustum.testBoxes(cullCenters_.data(), cullExtents_.data(), prims.size(), cullVisible_.data());
+        for (size_t i = 0; i < prims.size(); ++i)
+            if (cullVisible_[i])
+                push(i, identityInstances_, glm::length(cullCenters_[i] - camPos_));
+        return;
+    }
+
+    // world bounds of each instance: the model box under translate * scale
+    const auto &instances = *d.instances;
+    const glm::vec3 modelCenter = (model.boundsMin() + model.boundsMax()) * 0.5f;
+    const glm::vec3 modelExtent = (model.boundsMax() - model.boundsMin()) * 0.5f;
     for (const auto &inst : instances)
     {
-        glm::mat4 M(1.0f);
-        M = glm::translate(M, inst.position);
-        M = glm::scale(M, inst.scale);
-        glm::mat4 LMVP = lightProj * lightView * M;
-        shadow_->setMatrix4("uLightMVP", &LMVP[0][0]);
-        model.draw(*shadow_);
+        cullCenters_.push_back(inst.position + inst.scale * modelCenter);
+        cullExtents_.push_back(glm::abs(inst.scale) * modelExtent);
     }
-    glCullFace(GL_BACK);
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // scene pass per instance
-    if (screenW_ > 0 && screenH_ > 0)
-        glViewport(0, 0, screenW_, screenH_);
-    glClearColor(0.1f, 0.16f, 0.24f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    const unsigned idx[] = {
-        // Z- face (front, outward normal -Z): keep CCW
-        0, 1, 2, 0, 2, 3,
-        // Z+ face (back, outward normal +Z): reverse winding
-        4, 6, 5, 4, 7, 6,
-        // X- face (left, outward normal -X): reverse winding
-        8, 10, 9, 8, 11, 10,
-        // X+ face (right, outward normal +X): keep CCW
-        12, 13, 14, 12, 14, 15,
-        // Y- face (bottom, outward normal -Y): reverse winding
-        16, 18, 17, 16, 19, 18,
-        // Y+ face (top, outward normal +Y): keep CCW
-        20, 21, 22, 20, 22, 23};
-    pbr_->set3f("uCameraPos", camPos_.x, camPos_.y, camPos_.z);
-    pbr_->set1f("uEnvSpecStrength", 2.0f);
-    pbr_->set1f("uEnvDiffStrength", 1.0f);
-    pbr_->set1f("uOverrideRoughness", 0.25f);
-    pbr_->set1f("uOverrideMetallic", -1.0f);
-
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, shadowTex_);
-    if (env_ && env_->id())
+    cullVisible_.resize(instances.size());
+    frustum.testBoxes(cullCenters_.data(), cullExtents_.data(), instances.size(), cullVisible_.data());
+
+    // each pass gets its own stream holding only the instances it can see;
+    // the batch sorts by its nearest instance
+    instanceScratch_.clear();
+    float nearest = viewFar_;
+    for (size_t i = 0; i < instances.size(); ++i)
     {
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, env_->id());
+        if (!cullVisible_[i])
+            continue;
+        instanceScratch_.push_back(InstanceData::fromTranslateScale(instances[i].position, instances[i].scale));
+        nearest = std::min(nearest, glm::length(cullCenters_[i] - camPos_));
     }
+    if (instanceScratch_.empty())
+        return;
+    InstanceBuffer &buffer = *instancePool_[d.firstBuffer + pass];
+    buffer.upload(instanceScratch_);
+    for (size_t i = 0; i < prims.size(); ++i)
+        push(i, buffer, nearest);
+}
 
-    for (const auto &inst : instances)
+void Renderer::flushQueue(bool shadow)
+{
+    queue_.sort();
+    const ShaderProgram *program = shadow ? shadow_ : nullptr;
+    GLState &gs = glState();
+    uint32_t variant = ~0u;
+    const AssimpModel *boundModel = nullptr;
+    int boundMaterial = -2;
+    for (const auto &item : queue_.items())
     {
+        const QueuedDraw &q = queued_[item.payload];
+        if (q.features != variant && !shadow)
+        {
+            variant = q.features;
+            program = pbrVariant(variant);
+            if (!program)
+                continue;
+            program->use();
+            pbrU_.overrideRoughness = program->uniform("uOverrideRoughness");
+            pbrU_.boxUVScale = program->uniform("uBoxUVScale");
+            pbrU_.baseColorFactor = program->uniform("uBaseColorFactor");
+            pbrMaterialU_ = AMaterialUniforms::resolve(*program);
+            boundModel = nullptr; // material uniforms are per program
+            // inputs the variant takes from the renderer rather than a material
+            if (variant & kPbrBoxUV)
+            {
+                program->set4f(pbrU_.baseColorFactor, 1.f, 1.f, 1.f, 1.f);
+                program->set1f(pbrU_.overrideRoughness, voxelDraw_.roughness);
+                program->set1f(pbrU_.boxUVScale, voxelDraw_.uvTilesPerMeter);
+                gs.bindTexture(0, GL_TEXTURE_2D, gridTex_);
+            }
+            else
+            {
+                program->set1f(pbrU_.overrideRoughness, 0.25f);
+            }
+        }
+        if (!program)
+            continue;
+        if (!q.model)
+        {
+            drawVoxelRanges(*q.frustum);
+            continue;
+        }
+        const int material = q.model->primitives()[q.primitive].materialIndex;
+        if (q.model != boundModel || material != boundMaterial)
+        {
+            q.model->bindMaterial(*program, shadow ? shadowMaterialU_ : pbrMaterialU_, material);
+            boundModel = q.model;
+            boundMaterial = material;
+        }
+        q.model->drawPrimitive(q.primitive, *q.instances);
+    }
+}
+
+void Renderer::colliderPass()
+{
+    GLState &gs = glState();
+    gs.setEnabled(GL_CULL_FACE, false);
+    gs.polygonMode(GL_LINE);
+    debug_->use();
+    debug_->set3f(debugColorU_, 1.0f, 0.1f, 0.1f);
+    gs.bindVertexArray(voxelVAO_);
+    for (const auto &b : *colliders_)
+    {
+        glm::vec3 center = (b.min + b.max) * 0.5f;
+        glm::vec3 size = (b.max - b.min);
         glm::mat4 M(1.0f);
-        M = glm::translate(M, inst.position);
-        M = glm::scale(M, inst.scale);
+        M = glm::translate(M, center);
+        M = glm::scale(M, size);
         glm::mat4 MVP = proj_ * view_ * M;
-        glm::mat3 N = glm::mat3(glm::transpose(glm::inverse(M)));
-        pbr_->setMatrix4("uModel", &M[0][0]);
-        pbr_->setMatrix4("uMVP", &MVP[0][0]);
-        glUniformMatrix3fv(glGetUniformLocation(pbr_->id(), "uNormalMatrix"), 1, GL_FALSE, &N[0][0]);
-        model.draw(*pbr_);
+        debug_->setMatrix4(debugMVPU_, &MVP[0][0]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
     }
 }
 
@@ -506,145 +933,101 @@ bool Renderer::ensureVoxelResources()
             // +Y face (outward +Y)
             20, 22, 21, 20, 23, 22};
         glGenVertexArrays(1, &voxelVAO_);
-        glBindVertexArray(voxelVAO_);
+        glState().bindVertexArray(voxelVAO_);
         glGenBuffers(1, &voxelVBO_);
         glBindBuffer(GL_ARRAY_BUFFER, voxelVBO_);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(v), v, GL_STATIC_DRAW);
+        VoxelVertex packed[24];
+        for (int i = 0; i < 24; ++i)
+        {
+            const float *f = v + i * 8;
+            packed[i] = VoxelVertexFormat::pack(glm::vec3(f[0], f[1], f[2]), glm::vec3(f[3], f[4], f[5]), glm::vec2(f[6], f[7]));
+        }
+        glBufferData(GL_ARRAY_BUFFER, sizeof(packed), packed, GL_STATIC_DRAW);
         glGenBuffers(1, &voxelEBO_);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, voxelEBO_);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
-        const GLsizei stride = (3 + 3 + 2) * sizeof(float);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
-        glBindVertexArray(0);
+        VoxelVertexFormat::setup();
+        glState().bindVertexArray(0);
     }
     if (!gridTex_)
     {
-        int w = 0, h = 0, c = 0;
-        unsigned char *data = stbi_load("assets/grid.png", &w, &h, &c, 4);
-        if (data)
-        {
-            glGenTextures(1, &gridTex_);
-            glBindTexture(GL_TEXTURE_2D, gridTex_);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            stbi_image_free(data);
-        }
-        else
-        {
-            fprintf(stderr, "Failed to load assets/grid.png (w=%d h=%d c=%d)\n", w, h, c);
-        }
+        // decoded in the background; samples white until it arrives
+        static const uint8_t kWhite[4] = {255, 255, 255, 255};
+        gridTex_ = textureStreamer().requestFile("assets/grid.png", TextureUsage::Color, kWhite);
+        glState().bindTextureForUpdate(GL_TEXTURE_2D, gridTex_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     }
     return voxelVAO_ != 0;
 }
 
-void Renderer::drawVoxels(const VoxelWorld &world, float roughness, float uvTilesPerMeter)
+void Renderer::syncVoxelMesh(const VoxelWorld &world)
 {
-    if (!ensureVoxelResources())
+    if (voxelMeshVAO_ && voxelMeshWorld_ == &world && voxelMeshRevision_ == world.meshRevision())
         return;
-
-    // light matrices
-    glm::vec3 lightPos = -lightDir_ * 64.0f;
-    glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0, 1, 0));
-    glm::mat4 lightProj = glm::ortho(-32.0f, 32.0f, -32.0f, 32.0f, 1.0f, 128.0f);
-
-    // shadow pass
-    glViewport(0, 0, 4096, 4096);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO_);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glPolygonOffset(2.f, 4.f);
-    shadow_->use();
-    if (!dbgDisableCull_) { glEnable(GL_CULL_FACE); glCullFace(GL_FRONT); }
-    glBindVertexArray(voxelVAO_);
-    if (!world.voxels().empty())
+    if (!voxelMeshVAO_)
     {
-        const auto &v = world.voxels().front();
-        glm::vec3 center = v.center;
-        glm::vec3 size = v.size;
-        glm::mat4 M(1.0f);
-        M = glm::translate(M, center);
-        M = glm::scale(M, size);
-        glm::mat4 LMVP = lightProj * lightView * M;
-        shadow_->setMatrix4("uLightMVP", &LMVP[0][0]);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        glGenVertexArrays(1, &voxelMeshVAO_);
+        glGenBuffers(1, &voxelMeshVBO_);
+        glGenBuffers(1, &voxelMeshEBO_);
+        glState().bindVertexArray(voxelMeshVAO_);
+        glBindBuffer(GL_ARRAY_BUFFER, voxelMeshVBO_);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, voxelMeshEBO_);
+        VoxelVertexFormat::setup();
     }
-    glBindVertexArray(0);
-    if (!dbgDisableCull_) glCullFace(GL_BACK);
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // scene pass
-    if (screenW_ > 0 && screenH_ > 0)
-        glViewport(0, 0, screenW_, screenH_);
-    glClearColor(0.1f, 0.16f, 0.24f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    drawSky();
-
-    pbr_->use();
-    pbr_->set1i("uShadowMap", 3);
-    pbr_->set1i("uEnvEquirect", 4);
-    pbr_->set3f("uLightDir", lightDir_.x, lightDir_.y, lightDir_.z);
-    pbr_->set3f("uLightColor", 5.f, 5.f, 5.f);
-    pbr_->set3f("uAmbientColor", 0.05f, 0.05f, 0.05f);
-    pbr_->set3f("uCameraPos", camPos_.x, camPos_.y, camPos_.z);
-    pbr_->set1f("uEnvSpecStrength", 2.0f);
-    pbr_->set1f("uEnvDiffStrength", 1.0f);
-    pbr_->set1f("uOverrideRoughness", roughness);
-    pbr_->set1f("uOverrideMetallic", -1.0f);
-    pbr_->set1i("uHasORM", 0);
-    pbr_->set1i("uHasNormal", 0);
-    pbr_->set1i("uHasRoughness", 0);
-    pbr_->set1i("uHasMetalness", 0);
-    pbr_->set4f("uBaseColorFactor", 1.f, 1.f, 1.f, 1.f);
-    pbr_->set1i("uUseBoxUVMapping", 1);
-    pbr_->set1f("uBoxUVScale", uvTilesPerMeter);
-
-    // Bind grid texture as base color
-    pbr_->set1i("uBaseColorTex", 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gridTex_);
-
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, shadowTex_);
-    if (env_ && env_->id())
+    else
+    {
+        glState().bindVertexArray(voxelMeshVAO_);
+        glBindBuffer(GL_ARRAY_BUFFER, voxelMeshVBO_);
+    }
+    const auto &verts = world.meshVertices();
+    const auto &idx = world.meshIndices();
+    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(VoxelVertex), verts.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(uint32_t), idx.data(), GL_STATIC_DRAW);
+    identityInstances_.attachTo(voxelMeshInstanceSource_);
+    voxelMeshIndexCount_ = (GLsizei)idx.size();
+    voxelRangeFirst_.clear();
+    voxelRangeCount_.clear();
+    voxelRangeCenters_.clear();
+    voxelRangeExtents_.clear();
+    for (const auto &r : world.meshRanges())
     {
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, env_->id());
+        voxelRangeFirst_.push_back((GLsizei)r.firstIndex);
+        voxelRangeCount_.push_back((GLsizei)r.indexCount);
+        voxelRangeCenters_.push_back((r.boundsMin + r.boundsMax) * 0.5f);
+        voxelRangeExtents_.push_back((r.boundsMax - r.boundsMin) * 0.5f);
     }
+    voxelMeshWorld_ = &world;
+    voxelMeshRevision_ = world.meshRevision();
+    // static geometry changed: cached cascades redraw
+    for (int i = kFirstCachedCascade; i < kCascadeCount; ++i)
+        cascades_[i].valid = false;
+}
 
-    if (dbgWireframe_) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    if (dbgDisableCull_) glDisable(GL_CULL_FACE);
-    glBindVertexArray(voxelVAO_);
-    if (!world.voxels().empty())
+void Renderer::drawVoxelRanges(const Frustum &frustum)
+{
+    const size_t n = voxelRangeCenters_.size();
+    cullVisible_.resize(n);
+    frustum.testBoxes(voxelRangeCenters_.data(), voxelRangeExtents_.data(), n, cullVisible_.data());
+    multiCounts_.clear();
+    multiOffsets_.clear();
+    GLsizei runEnd = -1;
+    for (size_t i = 0; i < n; ++i)
     {
-        const auto &v = world.voxels().front();
-        glm::vec3 center = v.center;
-        glm::vec3 size = v.size;
-        glm::mat4 M(1.0f);
-        M = glm::translate(M, center);
-        M = glm::scale(M, size);
-        glm::mat4 MVP = proj_ * view_ * M;
-        glm::mat4 LMVP = lightProj * lightView * M;
-        glm::mat3 N = glm::mat3(glm::transpose(glm::inverse(M)));
-        pbr_->setMatrix4("uModel", &M[0][0]);
-        pbr_->setMatrix4("uMVP", &MVP[0][0]);
-        pbr_->setMatrix4("uLightMVP", &LMVP[0][0]);
-        glUniformMatrix3fv(glGetUniformLocation(pbr_->id(), "uNormalMatrix"), 1, GL_FALSE, &N[0][0]);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        if (!cullVisible_[i])
+            continue;
+        if (voxelRangeFirst_[i] == runEnd)
+            multiCounts_.back() += voxelRangeCount_[i];
+        else
+        {
+            multiCounts_.push_back(voxelRangeCount_[i]);
+            multiOffsets_.push_back((const void *)(sizeof(uint32_t) * (size_t)voxelRangeFirst_[i]));
+        }
+        runEnd = voxelRangeFirst_[i] + voxelRangeCount_[i];
     }
-    glBindVertexArray(0);
-    if (dbgWireframe_) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    if (dbgDisableCull_) glEnable(GL_CULL_FACE);
-    // restore mapping flag if subsequent draws occur
-    pbr_->set1i("uUseBoxUVMapping", 0);
+    if (multiCounts_.empty())
+        return;
+    // non-instanced draws read instance 0 of the attached identity stream
+    glState().bindVertexArray(voxelMeshVAO_);
+    glMultiDrawElements(GL_TRIANGLES, multiCounts_.data(), GL_UNSIGNED_INT, multiOffsets_.data(), (GLsizei)multiCounts_.size());
 }
@@ -1,11 +1,19 @@
 #pragma once
 #include <glad/gl.h>
 #include <glm/glm.hpp>
+#include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
+#include "instance_buffer.h"
+#include "frustum.h"
+#include "frame_graph.h"
+#include "render_queue.h"
+#include "assimp_model.h"
+#include "shader_watcher.h"
 
 class ShaderProgram;
-class AssimpModel;
+class ShaderVariants;
 class EnvironmentMap;
 struct LevelInstance;
 struct AABB;
@@ -21,44 +29,172 @@ public:
     void setEnvironment(const EnvironmentMap *env);
     void setCamera(const glm::mat4 &proj, const glm::mat4 &view, const glm::vec3 &camPos);
     void setLightDir(const glm::vec3 &dir);
+    // Build the pbr variants a model's materials draw with now, not on first draw.
+    // Submitting a model prewarms it once; call this after loading to move the
+    // compile off the frame that first shows it.
+    void prewarm(const AssimpModel &model);
     // Set the default framebuffer viewport size (pixels)
     void setViewportSize(int w, int h) { screenW_ = w; screenH_ = h; }
-    void drawScene(const AssimpModel &model);
-    // Render helper: draw a model multiple times with instance transforms
-    void drawInstances(const AssimpModel& model, const std::vector<LevelInstance>& instances);
-    // Visualize collision boxes (voxels) using a grid texture with specified roughness
-    void drawVoxels(const VoxelWorld& world, float roughness = 0.75f, float uvTilesPerMeter = 1.0f);
+    // Draw the frame into `fbo` instead of the default framebuffer (offscreen benchmark)
+    void setOutputFramebuffer(GLuint fbo) { outputFBO_ = fbo; }
+    // Time each frame graph pass on the GPU; null turns timing off
+    void setPassTimer(GpuPassTimer *timer) { graph_.setTimer(timer); }
+
+    // Frame: beginFrame, any number of submits, endFrame. Submitted objects are
+    // referenced, not copied, and must stay alive until endFrame.
+    void beginFrame();
+    void submitScene(const AssimpModel &model);
+    // A model once per instance; each pass is one instanced draw per primitive.
+    // Bump `revision` whenever the list's contents change: cached shadow
+    // cascades only notice lists appearing, disappearing or changing size.
+    void submitInstances(const AssimpModel& model, const std::vector<LevelInstance>& instances, uint64_t revision = 0);
+    // The voxel world's merged surface mesh using a grid texture with specified roughness
+    void submitVoxels(const VoxelWorld& world, float roughness = 0.75f, float uvTilesPerMeter = 1.0f);
+    // Debug: collider AABBs as a wireframe overlay
+    void submitColliders(const std::vector<AABB>& colliders);
+    // One shadow pass per redrawn cascade, then main and sky passes, over everything submitted
+    void endFrame();
+
     void enableSky(bool enable) { skyEnabled_ = enable; }
     // Debug rendering options
     void setDebugOptions(bool wireframe, bool disableCulling) { dbgWireframe_ = wireframe; dbgDisableCull_ = disableCulling; }
-    // Debug: draw collider AABBs as wireframe
-    void drawColliders(const std::vector<AABB>& colliders);
 
 private:
+    struct ModelDraw
+    {
+        const AssimpModel *model = nullptr;
+        const std::vector<LevelInstance> *instances = nullptr; // null: one identity instance
+        size_t firstBuffer = 0; // instancePool_ slots, one per cascade plus the camera
+        uint64_t revision = 0;
+    };
+    struct VoxelDraw
+    {
+        const VoxelWorld *world = nullptr;
+        float roughness = 0.75f;
+        float uvTilesPerMeter = 1.0f;
+    };
+
     bool initShadow();
+    // Block bindings, sampler units and uniform handles; again after every hot reload
+    void configurePrograms();
+    void configurePbr(ShaderProgram &program);
+    // The pbr variant for a feature mask, built and configured on first use; null if it fails to build
+    ShaderProgram *pbrVariant(uint32_t features);
+    // Rebuild programs whose sources changed on disk, swapping each in once linked
+    void reloadChangedShaders();
+    // Frame graph pass bodies; the graph has already bound, sized and cleared the target
     void drawSky();
+    void shadowPass(int cascade);
+    void opaquePass();
+    void colliderPass();
+    // Per-pass render queue: cull submissions into sorted draw items, then draw them in key order
+    struct QueuedDraw
+    {
+        const AssimpModel *model = nullptr; // null: the voxel surface
+        const InstanceBuffer *instances = nullptr;
+        uint32_t primitive = 0;
+        const Frustum *frustum = nullptr; // voxels: chunk ranges are culled at draw time
+        uint32_t features = 0;            // pbr variant (PbrFeature bits)
+    };
+    void beginQueue();
+    void queueVoxels(int pass);
+    // pass < kCascadeCount: that cascade; kCascadeCount: the camera
+    void queueModel(const ModelDraw &d, size_t drawIndex, int pass);
+    void flushQueue(bool shadow);
+    // Fit each cascade to its slice of the view frustum; cached cascades keep their fit while it still covers the slice
+    void fitCascades();
     bool ensureVoxelResources();
+    // Upload the world's greedy mesh if it changed since the last upload
+    void syncVoxelMesh(const VoxelWorld &world);
+    // Upload the per-frame uniform block if camera/light changed since last upload
+    void updateFrameUniforms();
+    // Draw the voxel chunk ranges inside `frustum`, adjacent ranges merged into one multi-draw
+    void drawVoxelRanges(const Frustum &frustum);
 
     const EnvironmentMap *env_ = nullptr;
-    GLuint shadowFBO_ = 0, shadowTex_ = 0;
+    // Cascaded shadow map: one layer of shadowTex_ (2D array) per cascade
+    static constexpr int kCascadeCount = 4;
+    struct ShadowCascade
+    {
+        glm::mat4 viewProj{1.0f};
+        Frustum frustum;
+        glm::vec3 centerLS{0.0f}; // fitted sphere, light space
+        float radius = 0.0f;
+        float splitFar = 0.0f;   // view depth where this cascade ends
+        bool valid = false;      // cached contents still match viewProj and the scene
+        bool refresh = false;    // redrawn this frame
+    };
+    ShadowCascade cascades_[kCascadeCount];
+    // Submitted models and instance lists last frame; a change redraws the cached cascades
+    uint64_t sceneSignature_ = 0;
+    GLuint shadowFBO_[kCascadeCount] = {}, shadowTex_ = 0;
+    GLint shadowCascadeU_ = -1;
+    GLuint frameUBO_ = 0;
+    bool frameDirty_ = true;
     GLuint screenVAO_ = 0;
     // Voxel resources
     GLuint voxelVAO_ = 0, voxelVBO_ = 0, voxelEBO_ = 0;
     GLuint gridTex_ = 0;
+    // Merged voxel surface (world space, drawn with the identity instance)
+    GLuint voxelMeshVAO_ = 0, voxelMeshVBO_ = 0, voxelMeshEBO_ = 0;
+    GLsizei voxelMeshIndexCount_ = 0;
+    const VoxelWorld *voxelMeshWorld_ = nullptr;
+    uint32_t voxelMeshRevision_ = 0;
+    uint32_t voxelMeshInstanceSource_ = 0;
+    // Per-chunk index ranges of the voxel mesh and their bounds (center/half extent)
+    std::vector<GLsizei> voxelRangeFirst_, voxelRangeCount_;
+    std::vector<glm::vec3> voxelRangeCenters_, voxelRangeExtents_;
+
+    // Instance streams: a single identity transform, plus a pool handed out per submitted instance list
+    InstanceBuffer identityInstances_;
+    std::vector<std::unique_ptr<InstanceBuffer>> instancePool_;
+    size_t instancePoolUsed_ = 0;
+    std::vector<InstanceData> instanceScratch_;
+
+    // This frame's submissions
+    FrameGraph graph_;
+    std::vector<ModelDraw> modelDraws_;
+    // Models whose variants were requested; an address reused by another model
+    // only falls back to building its variants in flushQueue
+    std::unordered_set<const AssimpModel *> prewarmed_;
+    VoxelDraw voxelDraw_;
+    const std::vector<AABB> *colliders_ = nullptr;
+    RenderQueue queue_;
+    std::vector<QueuedDraw> queued_;
+    float viewFar_ = 200.0f; // camera far plane, scales the queue's depth field
+
+    // Culling: frusta rebuilt with the frame uniforms, scratch reused across draws
+    Frustum cameraFrustum_;
+    std::vector<glm::vec3> cullCenters_, cullExtents_;
+    std::vector<uint8_t> cullVisible_;
+    std::vector<GLsizei> multiCounts_;
+    std::vector<const void *> multiOffsets_;
 
     ShaderProgram *sky_ = nullptr;
-    ShaderProgram *pbr_ = nullptr;
+    ShaderVariants *pbr_ = nullptr; // pbr.vert/pbr.frag by PbrFeature mask
     ShaderProgram *shadow_ = nullptr;
     ShaderProgram *debug_ = nullptr; // simple color shader
+    ShaderWatcher shaderWatcher_;
+
+    // Per-draw uniform handles: the pbr ones belong to the variant flushQueue last switched to
+    struct PbrUniforms
+    {
+        GLint overrideRoughness = -1;
+        GLint boxUVScale = -1;
+        GLint baseColorFactor = -1;
+    } pbrU_;
+    AMaterialUniforms pbrMaterialU_, shadowMaterialU_;
+    GLint debugMVPU_ = -1, debugColorU_ = -1;
 
     glm::mat4 proj_{1.0f}, view_{1.0f};
     glm::vec3 camPos_{0.0f};
     glm::vec3 lightDir_{-0.3f, -1.0f, -0.2f};
     bool skyEnabled_ = false;
 
-    // Default framebuffer dimensions (set by app each frame)
+    // Output framebuffer dimensions (set by app each frame)
     int screenW_ = 0;
     int screenH_ = 0;
+    GLuint outputFBO_ = 0;
 
     // Debug flags
     bool dbgWireframe_ = false;
@@ -1,10 +1,151 @@
 #include "shader.h"
+#include "model_cache.h"
 #include <vector>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 
+namespace {
+constexpr char kBinaryMagic[4] = {'Q', 'P', 'B', '1'};
+
+// Cached program file: this header, then the driver's binary
+struct BinaryHeader {
+    char magic[4];
+    uint32_t format; // from glGetProgramBinary
+    uint64_t key;    // see programKey
+    uint64_t bytes;
+};
+static_assert(sizeof(BinaryHeader) == 24, "binary header is written as raw bytes");
+
+bool binariesSupported() {
+    static const bool supported = [] {
+        // the loader is generated for 3.3, so the entry points are only loaded
+        // through the extension, even on a 4.1+ context
+        if (!GLAD_GL_ARB_get_program_binary) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported;
+}
+
+// Binaries are only valid for the driver that produced them
+uint64_t programKey(const std::string& vs, const std::string& fs) {
+    std::string driver;
+    for (GLenum e : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* str = reinterpret_cast<const char*>(glGetString(e));
+        driver += str ? str : "";
+        driver += '\n';
+    }
+    uint64_t h = hashBytes(vs.data(), vs.size());
+    h = hashBytes(fs.data(), fs.size(), h);
+    return hashBytes(driver.data(), driver.size(), h);
+}
+
+// shaders/a.vert + shaders/a.frag -> shaders/.cache/a.vert+a.frag[.<defines hash>].bin
+std::string binaryPath(const std::string& vsPath, const std::string& fsPath, const std::string& defines) {
+    std::filesystem::path vs(vsPath), fs(fsPath);
+    std::string name = vs.filename().string() + "+" + fs.filename().string();
+    if (!defines.empty()) {
+        char hex[20];
+        std::snprintf(hex, sizeof(hex), ".%016" PRIx64, hashBytes(defines.data(), defines.size()));
+        name += hex;
+    }
+    return (vs.parent_path() / ".cache" / (name + ".bin")).string();
+}
+
+// Shared declarations, inserted into every file-backed stage after its defines
+const char* kPreludeFile = "frame_uniforms.glsl";
+
+std::string preludePath(const std::string& vsPath) {
+    return (std::filesystem::path(vsPath).parent_path() / kPreludeFile).string();
+}
+
+// Defines and the prelude go after #version, which must stay the first
+// directive; #line then restores the file's own numbering for compiler messages
+void insertDefines(std::string& src, const std::string& defines) {
+    if (defines.empty()) return;
+    size_t at = src.find("#version");
+    at = at == std::string::npos ? 0 : src.find('\n', at);
+    at = at == std::string::npos ? src.size() : at + 1;
+    const long nextLine = 1 + (long)std::count(src.begin(), src.begin() + (long)at, '\n');
+    src.insert(at, defines + "#line " + std::to_string(nextLine) + "\n");
+}
+
+GLuint loadBinary(const std::string& path, uint64_t key) {
+    MappedFile file;
+    if (!binariesSupported() || !file.open(path) || file.size() < sizeof(BinaryHeader)) return 0;
+    BinaryHeader h;
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (std::memcmp(h.magic, kBinaryMagic, 4) != 0 || h.key != key || h.bytes != file.size() - sizeof(h)) return 0;
+    GLuint p = glCreateProgram();
+    glProgramBinary(p, (GLenum)h.format, file.data() + sizeof(h), (GLsizei)h.bytes);
+    GLint ok = 0; glGetProgramiv(p, GL_LINK_STATUS, &ok);
+    if (!ok) { glDeleteProgram(p); return 0; } // drivers may refuse even a matching binary
+    return p;
+}
+
+void saveBinary(GLuint program, const std::string& path, uint64_t key) {
+    if (!binariesSupported()) return;
+    GLint len = 0; glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0) return;
+    std::vector<uint8_t> data(sizeof(BinaryHeader) + (size_t)len);
+    GLsizei written = 0; GLenum format = 0;
+    glGetProgramBinary(program, len, &written, &format, data.data() + sizeof(BinaryHeader));
+    if (written <= 0) return;
+    BinaryHeader h{};
+    std::memcpy(h.magic, kBinaryMagic, 4);
+    h.format = format;
+    h.key = key;
+    h.bytes = (uint64_t)written;
+    std::memcpy(data.data(), &h, sizeof(h));
+    data.resize(sizeof(h) + (size_t)written);
+
+    // Write to a temporary and rename so a crash never leaves a truncated binary behind
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    const std::string tmp = path + ".tmp";
+    bool ok = false;
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        ok = f && f.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+    }
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) std::filesystem::remove(tmp, ec);
+}
+
+void appendInfoLog(GLuint object, bool program, std::string* log) {
+    if (!log || !object) return;
+    GLint len = 0;
+    if (program) glGetProgramiv(object, GL_INFO_LOG_LENGTH, &len);
+    else glGetShaderiv(object, GL_INFO_LOG_LENGTH, &len);
+    if (len <= 1) return;
+    std::vector<char> buf(len);
+    if (program) glGetProgramInfoLog(object, len, nullptr, buf.data());
+    else glGetShaderInfoLog(object, len, nullptr, buf.data());
+    *log += std::string(buf.data(), buf.size() - 1);
+}
+} // namespace
+
 ShaderProgram::~ShaderProgram() {
-    if (program_) glDeleteProgram(program_);
+    discardReload();
+    if (program_) {
+        glState().forgetProgram(program_);
+        glDeleteProgram(program_);
+    }
+}
+
+void ShaderProgram::replace(GLuint program) {
+    if (program_) {
+        glState().forgetProgram(program_);
+        glDeleteProgram(program_);
+    }
+    program_ = program;
+    reflect();
 }
 
 bool ShaderProgram::readFile(const std::string& path, std::string& out) {
@@ -34,63 +175,199 @@ GLuint ShaderProgram::compile(GLenum type, const std::string& src, std::string*
     return s;
 }
 
-bool ShaderProgram::loadFromFiles(const std::string& vsPath, const std::string& fsPath, std::string* log) {
-    std::string vs, fs;
-    if (!readFile(vsPath, vs) || !readFile(fsPath, fs)) {
-        if (log) *log += "Failed to read shader files\n";
-        return false;
-    }
+GLuint ShaderProgram::link(const std::string& vs, const std::string& fs, std::string* log) {
     GLuint v = compile(GL_VERTEX_SHADER, vs, log);
+    if (!v) return 0;
     GLuint f = compile(GL_FRAGMENT_SHADER, fs, log);
-    if (!v || !f) return false;
+    if (!f) { glDeleteShader(v); return 0; }
     GLuint p = glCreateProgram();
     glAttachShader(p, v);
     glAttachShader(p, f);
+    if (binariesSupported()) glProgramParameteri(p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(p);
     glDeleteShader(v);
     glDeleteShader(f);
     GLint ok = 0; glGetProgramiv(p, GL_LINK_STATUS, &ok);
     if (!ok) {
-        GLint len = 0; glGetProgramiv(p, GL_INFO_LOG_LENGTH, &len);
-        std::vector<char> buf(len);
-        glGetProgramInfoLog(p, len, nullptr, buf.data());
-        if (log) *log += std::string(buf.data(), buf.size());
+        appendInfoLog(p, true, log);
         glDeleteProgram(p);
+        return 0;
+    }
+    return p;
+}
+
+bool ShaderProgram::readSources(std::string& vs, std::string& fs, std::string* log) const {
+    std::string prelude;
+    if (!readFile(vsPath_, vs) || !readFile(fsPath_, fs) || !readFile(preludePath(vsPath_), prelude)) {
+        if (log) *log += "Failed to read shader files\n";
         return false;
     }
-    program_ = p;
+    // both end up in the sources programKey hashes, so editing either misses the binary cache
+    if (!prelude.empty() && prelude.back() != '\n') prelude += '\n';
+    insertDefines(vs, defines_ + prelude);
+    insertDefines(fs, defines_ + prelude);
+    return true;
+}
+
+bool ShaderProgram::loadFromFiles(const std::string& vsPath, const std::string& fsPath, std::string* log, const std::string& defines) {
+    vsPath_ = vsPath;
+    fsPath_ = fsPath;
+    defines_ = defines;
+    std::string vs, fs;
+    if (!readSources(vs, fs, log)) return false;
+    const uint64_t key = programKey(vs, fs);
+    const std::string cachePath = binaryPath(vsPath, fsPath, defines);
+    GLuint p = loadBinary(cachePath, key);
+    if (!p) {
+        p = link(vs, fs, log);
+        if (!p) return false;
+        saveBinary(p, cachePath, key);
+    }
+    replace(p);
     return true;
 }
 
 bool ShaderProgram::loadFromSource(const char* vsSrc, const char* fsSrc, std::string* log)
 {
-    GLuint v = compile(GL_VERTEX_SHADER, vsSrc, log);
-    if (!v) return false;
-    GLuint f = compile(GL_FRAGMENT_SHADER, fsSrc, log);
-    if (!f) { glDeleteShader(v); return false; }
-    program_ = glCreateProgram();
-    glAttachShader(program_, v);
-    glAttachShader(program_, f);
-    glLinkProgram(program_);
-    glDeleteShader(v);
-    glDeleteShader(f);
-    GLint ok=0; glGetProgramiv(program_, GL_LINK_STATUS, &ok);
-    if (!ok){ if (log){ GLint len=0; glGetProgramiv(program_, GL_INFO_LOG_LENGTH, &len); if (len>1){ log->resize(len); glGetProgramInfoLog(program_, len, nullptr, log->data()); } } glDeleteProgram(program_); program_=0; return false; }
+    GLuint p = link(vsSrc, fsSrc, log);
+    if (!p) return false;
+    replace(p);
     return true;
 }
 
-void ShaderProgram::set1i(const char* name, int v) const {
-    glUniform1i(glGetUniformLocation(program_, name), v);
+bool ShaderProgram::startReload(std::string* log) {
+    std::string vs, fs;
+    if (vsPath_.empty() || !readSources(vs, fs, log)) return false;
+    discardReload(); // a newer save supersedes an unfinished build
+    pendingKey_ = programKey(vs, fs);
+    // No status queries here: they would wait for the compile to finish
+    const char* src[2] = {vs.c_str(), fs.c_str()};
+    GLuint* shaders[2] = {&pendingVS_, &pendingFS_};
+    pending_ = glCreateProgram();
+    for (int i = 0; i < 2; ++i) {
+        *shaders[i] = glCreateShader(i == 0 ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER);
+        glShaderSource(*shaders[i], 1, &src[i], nullptr);
+        glCompileShader(*shaders[i]);
+        glAttachShader(pending_, *shaders[i]);
+    }
+    if (binariesSupported()) glProgramParameteri(pending_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(pending_);
+    return true;
+}
+
+ShaderProgram::ReloadStatus ShaderProgram::pollReload(std::string* log) {
+    if (!pending_) return ReloadStatus::Idle;
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        GLint done = 0; glGetProgramiv(pending_, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) return ReloadStatus::Pending;
+    }
+    GLint ok = 0; glGetProgramiv(pending_, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        if (log) *log += vsPath_ + " + " + fsPath_ + ":\n";
+        appendInfoLog(pendingVS_, false, log);
+        appendInfoLog(pendingFS_, false, log);
+        appendInfoLog(pending_, true, log);
+        discardReload();
+        return ReloadStatus::Failed;
+    }
+    GLuint p = pending_;
+    pending_ = 0;
+    discardReload(); // just the shader objects now
+    saveBinary(p, binaryPath(vsPath_, fsPath_, defines_), pendingKey_);
+    replace(p);
+    return ReloadStatus::Swapped;
+}
+
+void ShaderProgram::discardReload() {
+    for (GLuint* s : {&pendingVS_, &pendingFS_}) {
+        if (*s) glDeleteShader(*s);
+        *s = 0;
+    }
+    if (pending_) glDeleteProgram(pending_);
+    pending_ = 0;
+}
+
+bool ShaderProgram::usesFile(const std::string& fileName) const {
+    namespace fs = std::filesystem;
+    return !vsPath_.empty() && (fs::path(vsPath_).filename() == fileName || fs::path(fsPath_).filename() == fileName ||
+                                fileName == kPreludeFile);
+}
+
+void ShaderProgram::reflect() {
+    uniforms_.clear();
+    blocks_.clear();
+    GLint count = 0, maxLen = 0;
+    glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLen);
+    std::vector<char> name(std::max(maxLen, 1));
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei len = 0; GLint size = 0; GLenum type = 0;
+        glGetActiveUniform(program_, (GLuint)i, (GLsizei)name.size(), &len, &size, &type, name.data());
+        std::string n(name.data(), len);
+        GLint loc = glGetUniformLocation(program_, n.c_str());
+        if (loc < 0) continue; // member of a uniform block
+        // arrays report "name[0]"; expose the base name too
+        if (n.size() > 3 && n.compare(n.size() - 3, 3, "[0]") == 0)
+            uniforms_[n.substr(0, n.size() - 3)] = loc;
+        uniforms_[n] = loc;
+    }
+    glGetProgramiv(program_, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    glGetProgramiv(program_, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLen);
+    name.assign(std::max(maxLen, 1), 0);
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei len = 0;
+        glGetActiveUniformBlockName(program_, (GLuint)i, (GLsizei)name.size(), &len, name.data());
+        blocks_[std::string(name.data(), len)] = (GLuint)i;
+    }
 }
-void ShaderProgram::set1f(const char* name, float v) const {
-    glUniform1f(glGetUniformLocation(program_, name), v);
+
+GLint ShaderProgram::uniform(const char* name) const {
+    auto it = uniforms_.find(name);
+    return it != uniforms_.end() ? it->second : -1;
 }
-void ShaderProgram::set3f(const char* name, float x, float y, float z) const {
-    glUniform3f(glGetUniformLocation(program_, name), x, y, z);
+
+GLuint ShaderProgram::uniformBlock(const char* name) const {
+    auto it = blocks_.find(name);
+    return it != blocks_.end() ? it->second : GL_INVALID_INDEX;
 }
-void ShaderProgram::set4f(const char* name, float x, float y, float z, float w) const {
-    glUniform4f(glGetUniformLocation(program_, name), x, y, z, w);
+
+void ShaderProgram::bindUniformBlock(const char* name, GLuint binding) const {
+    GLuint idx = uniformBlock(name);
+    if (idx != GL_INVALID_INDEX) glUniformBlockBinding(program_, idx, binding);
 }
-void ShaderProgram::setMatrix4(const char* name, const float* m) const {
-    glUniformMatrix4fv(glGetUniformLocation(program_, name), 1, GL_FALSE, m);
+
+void ShaderVariants::init(const std::string& vsPath, const std::string& fsPath, std::vector<std::string> featureNames) {
+    vsPath_ = vsPath;
+    fsPath_ = fsPath;
+    featureNames_ = std::move(featureNames);
+    variants_.clear();
+}
+
+ShaderProgram* ShaderVariants::get(uint32_t mask, bool* created) {
+    if (created) *created = false;
+    auto it = variants_.find(mask);
+    if (it != variants_.end()) return it->second.get();
+
+    std::string defines;
+    for (size_t i = 0; i < featureNames_.size(); ++i)
+        if (mask & (1u << i)) defines += "#define " + featureNames_[i] + "\n";
+    auto program = std::make_unique<ShaderProgram>();
+    std::string log;
+    if (!program->loadFromFiles(vsPath_, fsPath_, &log, defines)) {
+        std::fprintf(stderr, "ShaderVariants: %s variant 0x%x failed:\n%s\n", fsPath_.c_str(), mask, log.c_str());
+        program.reset();
+    } else if (created) {
+        *created = true;
+    }
+    return (variants_[mask] = std::move(program)).get();
+}
+
+void ShaderVariants::retryFailed() {
+    for (auto it = variants_.begin(); it != variants_.end();)
+        it = it->second ? std::next(it) : variants_.erase(it);
+}
+
+bool ShaderVariants::usesFile(const std::string& fileName) const {
+    namespace fs = std::filesystem;
+    return fs::path(vsPath_).filename() == fileName || fs::path(fsPath_).filename() == fileName || fileName == kPreludeFile;
 }
@@ -1,26 +1,97 @@
 #pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <glad/gl.h>
+#include "gl_state.h"
 
 class ShaderProgram {
 public:
     ShaderProgram() = default;
     ~ShaderProgram();
 
-    bool loadFromFiles(const std::string& vsPath, const std::string& fsPath, std::string* log = nullptr);
+    // The linked program is cached as a driver binary in <shader dir>/.cache,
+    // keyed by both sources plus the GL vendor/renderer/version strings; a miss
+    // or a binary the driver rejects compiles from source. `defines` ("#define X\n"
+    // lines), then the shared frame_uniforms.glsl from the same directory, are
+    // inserted after the #version line of both stages.
+    bool loadFromFiles(const std::string& vsPath, const std::string& fsPath, std::string* log = nullptr,
+                       const std::string& defines = std::string());
     bool loadFromSource(const char* vsSrc, const char* fsSrc, std::string* log = nullptr);
-    void use() const { glUseProgram(program_); }
+
+    // Hot reload of a file-backed program: startReload() compiles the current
+    // sources and pollReload() swaps the result in once linked, without waiting
+    // on drivers with KHR_parallel_shader_compile. On failure the old program
+    // stays. A swap invalidates uniform locations and program state (samplers,
+    // block bindings); callers re-resolve them.
+    enum class ReloadStatus { Idle, Pending, Swapped, Failed };
+    bool startReload(std::string* log = nullptr);
+    ReloadStatus pollReload(std::string* log = nullptr);
+    // Whether `fileName` (no directory) is one of this program's sources or the shared prelude
+    bool usesFile(const std::string& fileName) const;
+    void use() const { glState().useProgram(program_); }
     GLuint id() const { return program_; }
 
-    // convenience setters
-    void set1i(const char* name, int v) const;
-    void set1f(const char* name, float v) const;
-    void set3f(const char* name, float x, float y, float z) const;
-    void set4f(const char* name, float x, float y, float z, float w) const;
-    void setMatrix4(const char* name, const float* m) const;
+    // Reflected at link time; -1 / GL_INVALID_INDEX when the name is not active
+    GLint uniform(const char* name) const;
+    GLuint uniformBlock(const char* name) const;
+    // Attach a named uniform block to a binding point (no-op if the block is inactive)
+    void bindUniformBlock(const char* name, GLuint binding) const;
+
+    // convenience setters (location handles from uniform(); program must be in use)
+    void set1i(GLint loc, int v) const { glUniform1i(loc, v); }
+    void set1f(GLint loc, float v) const { glUniform1f(loc, v); }
+    void set3f(GLint loc, float x, float y, float z) const { glUniform3f(loc, x, y, z); }
+    void set4f(GLint loc, float x, float y, float z, float w) const { glUniform4f(loc, x, y, z, w); }
+    void setMatrix3(GLint loc, const float* m) const { glUniformMatrix3fv(loc, 1, GL_FALSE, m); }
+    void setMatrix4(GLint loc, const float* m) const { glUniformMatrix4fv(loc, 1, GL_FALSE, m); }
+
+    // by-name setters resolve through the reflected table (no GL query)
+    void set1i(const char* name, int v) const { set1i(uniform(name), v); }
+    void set1f(const char* name, float v) const { set1f(uniform(name), v); }
+    void set3f(const char* name, float x, float y, float z) const { set3f(uniform(name), x, y, z); }
+    void set4f(const char* name, float x, float y, float z, float w) const { set4f(uniform(name), x, y, z, w); }
+    void setMatrix3(const char* name, const float* m) const { setMatrix3(uniform(name), m); }
+    void setMatrix4(const char* name, const float* m) const { setMatrix4(uniform(name), m); }
 
 private:
     GLuint program_ = 0;
+    std::unordered_map<std::string, GLint> uniforms_;
+    std::unordered_map<std::string, GLuint> blocks_;
+    std::string vsPath_, fsPath_; // empty for loadFromSource
+    std::string defines_;
+    // In-flight reload
+    GLuint pending_ = 0, pendingVS_ = 0, pendingFS_ = 0;
+    uint64_t pendingKey_ = 0;
+
+    void reflect();
+    void replace(GLuint program);
+    void discardReload();
     static GLuint compile(GLenum type, const std::string& src, std::string* log);
+    static GLuint link(const std::string& vs, const std::string& fs, std::string* log);
     static bool readFile(const std::string& path, std::string& out);
+    bool readSources(std::string& vs, std::string& fs, std::string* log) const;
+};
+
+// Permutations of one vertex/fragment pair. Bit i of a feature mask compiles
+// the sources with "#define <featureNames[i]>"; each variant is built the first
+// time get() asks for it and kept, so callers prewarm by asking at load time.
+class ShaderVariants {
+public:
+    void init(const std::string& vsPath, const std::string& fsPath, std::vector<std::string> featureNames);
+    // Null if the variant failed to build (logged once; retried after retryFailed()).
+    // `created` reports a fresh program that still needs its per-program state.
+    ShaderProgram* get(uint32_t mask, bool* created = nullptr);
+    void retryFailed();
+    bool usesFile(const std::string& fileName) const;
+    // Built variants by mask; failed ones hold null
+    const std::map<uint32_t, std::unique_ptr<ShaderProgram>>& variants() const { return variants_; }
+
+private:
+    std::string vsPath_, fsPath_;
+    std::vector<std::string> featureNames_;
+    std::map<uint32_t, std::unique_ptr<ShaderProgram>> variants_;
 };
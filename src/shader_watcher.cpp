@@ -0,0 +1,73 @@
+#include "shader_watcher.h"
+#include <cstdio>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool ShaderWatcher::start(const std::string &dir)
+{
+    stop();
+#ifdef __linux__
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // editors either rewrite in place or rename a temporary over the file
+    if (fd_ < 0 || inotify_add_watch(fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        std::fprintf(stderr, "ShaderWatcher: cannot watch %s, hot reload disabled\n", dir.c_str());
+        stop();
+        return false;
+    }
+    stopping_ = false;
+    thread_ = std::thread([this] { run(); });
+    return true;
+#else
+    (void)dir;
+    return false;
+#endif
+}
+
+void ShaderWatcher::stop()
+{
+    stopping_ = true;
+    if (thread_.joinable())
+        thread_.join();
+#ifdef __linux__
+    if (fd_ >= 0)
+        ::close(fd_);
+#endif
+    fd_ = -1;
+}
+
+void ShaderWatcher::run()
+{
+#ifdef __linux__
+    alignas(inotify_event) char buf[4096];
+    while (!stopping_)
+    {
+        pollfd p{fd_, POLLIN, 0};
+        if (poll(&p, 1, 100) <= 0)
+            continue; // the timeout is what notices stop()
+        ssize_t n;
+        while ((n = read(fd_, buf, sizeof(buf))) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const char *at = buf; at < buf + n;)
+            {
+                const inotify_event *e = reinterpret_cast<const inotify_event *>(at);
+                if (e->len)
+                    changed_.insert(e->name);
+                at += sizeof(inotify_event) + e->len;
+            }
+        }
+    }
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::takeChanged()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> out(changed_.begin(), changed_.end());
+    changed_.clear();
+    return out;
+}
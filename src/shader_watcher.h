@@ -0,0 +1,31 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reports files written in one directory, for shader hot reload. A background
+// thread waits on inotify (Linux only; start() fails elsewhere) and collects
+// the names; the GL thread picks them up once per frame and rebuilds whatever
+// programs use them.
+class ShaderWatcher
+{
+public:
+    ~ShaderWatcher() { stop(); }
+
+    bool start(const std::string &dir);
+    void stop();
+    // File names (no directory) written since the last call, each once
+    std::vector<std::string> takeChanged();
+
+private:
+    void run();
+
+    int fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    std::mutex mutex_;
+    std::set<std::string> changed_;
+};
@@ -0,0 +1,75 @@
+#include "texture_cache.h"
+#include "gl_state.h"
+#include "model_cache.h"
+#include "texture_streamer.h"
+#include <cstdio>
+
+TextureCache &textureCache()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+TextureHandle TextureCache::acquire(const Key &key, size_t bytes, const std::function<GLuint()> &create)
+{
+    ++stats_.requests;
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+    {
+        ++stats_.hits;
+        stats_.bytesSaved += it->second->bytes;
+        return TextureHandle(it->second.get());
+    }
+    auto e = std::make_unique<Entry>();
+    e->key = key;
+    e->tex = create();
+    e->bytes = bytes;
+    if (!e->tex)
+        return TextureHandle();
+    ++stats_.live;
+    stats_.liveBytes += bytes;
+    Entry *raw = e.get();
+    entries_.emplace(key, std::move(e));
+    return TextureHandle(raw);
+}
+
+TextureHandle TextureCache::white()
+{
+    static const uint8_t kWhite[4] = {255, 255, 255, 255};
+    return acquire({hashBytes(kWhite, sizeof(kWhite)), true}, sizeof(kWhite), [] {
+        GLuint tex = 0;
+        glGenTextures(1, &tex);
+        glState().bindTextureForUpdate(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, kWhite);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return tex;
+    });
+}
+
+void TextureCache::release(Entry *e)
+{
+    if (--e->refs > 0)
+        return;
+    textureStreamer().cancel(e->tex);
+    glState().forgetTexture(e->tex);
+    glDeleteTextures(1, &e->tex);
+    --stats_.live;
+    stats_.liveBytes -= e->bytes;
+    const Key key = e->key;
+    entries_.erase(key); // destroys *e
+}
+
+void TextureCache::logStats() const
+{
+    std::fprintf(stderr, "TextureCache: %zu/%zu hits (%.0f%%), %.1f MB not re-uploaded, %zu textures live (%.1f MB)\n", stats_.hits,
+                 stats_.requests, stats_.requests ? 100.0 * stats_.hits / stats_.requests : 0.0, stats_.bytesSaved / (1024.0 * 1024.0),
+                 stats_.live, stats_.liveBytes / (1024.0 * 1024.0));
+}
+
+void TextureHandle::reset()
+{
+    if (entry_)
+        textureCache().release(entry_);
+    entry_ = nullptr;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <glad/gl.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+class TextureHandle;
+
+// Process-wide table of GL textures keyed by the content hash of their source
+// image plus colour space. Every model that asks for the same image gets the
+// same texture; the texture is deleted when the last handle goes away.
+class TextureCache
+{
+public:
+    struct Key
+    {
+        uint64_t contentHash = 0;
+        bool srgb = false;
+        bool operator==(const Key &o) const { return contentHash == o.contentHash && srgb == o.srgb; }
+    };
+    struct Stats
+    {
+        size_t requests = 0, hits = 0;
+        size_t bytesSaved = 0; // texel bytes a miss would have uploaded again
+        size_t live = 0, liveBytes = 0;
+    };
+
+    // Existing texture for `key`, or the one create() makes (GL thread only).
+    // `bytes` is the texture's upload size, for the statistics.
+    TextureHandle acquire(const Key &key, size_t bytes, const std::function<GLuint()> &create);
+    // Shared 1x1 sRGB white
+    TextureHandle white();
+
+    const Stats &stats() const { return stats_; }
+    void logStats() const;
+
+private:
+    friend class TextureHandle;
+    struct Entry
+    {
+        Key key;
+        GLuint tex = 0;
+        size_t bytes = 0;
+        uint32_t refs = 0;
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key &k) const { return (size_t)(k.contentHash ^ (k.srgb ? 0x9e3779b97f4a7c15ull : 0)); }
+    };
+    void release(Entry *e);
+
+    std::unordered_map<Key, std::unique_ptr<Entry>, KeyHash> entries_;
+    Stats stats_;
+};
+
+TextureCache &textureCache();
+
+// Counted reference to a cached texture; copies share it, the last one frees it
+class TextureHandle
+{
+public:
+    TextureHandle() = default;
+    ~TextureHandle() { reset(); }
+    TextureHandle(const TextureHandle &o) : entry_(o.entry_)
+    {
+        if (entry_) ++entry_->refs;
+    }
+    TextureHandle(TextureHandle &&o) noexcept : entry_(o.entry_) { o.entry_ = nullptr; }
+    TextureHandle &operator=(TextureHandle o) noexcept
+    {
+        std::swap(entry_, o.entry_);
+        return *this;
+    }
+
+    GLuint id() const { return entry_ ? entry_->tex : 0; }
+    explicit operator bool() const { return entry_ != nullptr; }
+    void reset();
+
+private:
+    friend class TextureCache;
+    explicit TextureHandle(TextureCache::Entry *e) : entry_(e) { ++entry_->refs; }
+    TextureCache::Entry *entry_ = nullptr;
+};
@@ -0,0 +1,206 @@
+#include "texture_streamer.h"
+#include "gl_state.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+TextureStreamer &textureStreamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+void TextureStreamer::startWorkers()
+{
+    // leave one core to the GL thread
+    unsigned n = std::thread::hardware_concurrency();
+    n = n > 1 ? n - 1 : 1;
+    stopping_ = false;
+    for (unsigned i = 0; i < n; ++i)
+        workers_.emplace_back([this] { workerLoop(); });
+}
+
+void TextureStreamer::workerLoop()
+{
+    PROFILE_THREAD("texture streamer");
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;)
+    {
+        wake_.wait(lock, [this] { return stopping_ || !queued_.empty(); });
+        if (stopping_)
+            return;
+        std::unique_ptr<Job> job = std::move(queued_.front());
+        queued_.pop_front();
+        producing_.push_back(job.get());
+        lock.unlock();
+        {
+            PROFILE_SCOPE("TextureStreamer produce");
+            // the function object stays alive with the job: its captures may own the pixels
+            job->ok = job->produce(job->storage, job->result) && !job->result.mips.empty();
+        }
+        lock.lock();
+        producing_.erase(std::find(producing_.begin(), producing_.end(), job.get()));
+        if (!job->cancelled)
+            done_.push_back(std::move(job));
+    }
+}
+
+GLuint TextureStreamer::request(ProduceFn produce, const uint8_t placeholder[4])
+{
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glState().bindTextureForUpdate(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    auto job = std::make_unique<Job>();
+    job->tex = tex;
+    job->produce = std::move(produce);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (workers_.empty())
+        startWorkers();
+    queued_.push_back(std::move(job));
+    wake_.notify_one();
+    return tex;
+}
+
+GLuint TextureStreamer::requestFile(const std::string &path, TextureUsage usage, const uint8_t placeholder[4])
+{
+    const bool compress = GLAD_GL_EXT_texture_compression_s3tc != 0;
+    return request(
+        [path, usage, compress](CookedModel &storage, CookedTexture &out) {
+            MappedFile file;
+            if (!file.open(path) || !cookImage(storage, out, file.data(), file.size(), usage, compress))
+            {
+                std::fprintf(stderr, "TextureStreamer: failed to load %s\n", path.c_str());
+                return false;
+            }
+            return true;
+        },
+        placeholder);
+}
+
+void TextureStreamer::cancel(GLuint tex)
+{
+    auto match = [tex](const std::unique_ptr<Job> &j) { return j->tex == tex; };
+    uploading_.erase(std::remove_if(uploading_.begin(), uploading_.end(), match), uploading_.end());
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_.erase(std::remove_if(queued_.begin(), queued_.end(), match), queued_.end());
+    done_.erase(std::remove_if(done_.begin(), done_.end(), match), done_.end());
+    // a worker still producing it drops the result when it finishes
+    for (Job *j : producing_)
+        if (j->tex == tex)
+            j->cancelled = true;
+}
+
+size_t TextureStreamer::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_.size() + producing_.size() + done_.size() + uploading_.size();
+}
+
+size_t TextureStreamer::uploadLevel(Job &job)
+{
+    const CookedTexture &t = job.result;
+    const int level = job.nextLevel;
+    const CookedMip &mip = t.mips[level];
+
+    // orphan and refill the staging buffer; the driver copies out of it asynchronously
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)mip.bytes, nullptr, GL_STREAM_DRAW);
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)mip.bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    const void *src = mip.data;
+    if (dst)
+    {
+        std::memcpy(dst, mip.data, (size_t)mip.bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        src = nullptr; // offset 0 into the bound buffer
+    }
+    else
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); // mapping failed: plain client-memory upload
+    }
+    glState().bindTextureForUpdate(GL_TEXTURE_2D, job.tex);
+    if (t.compressed())
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, t.internalFormat, (GLsizei)mip.width, (GLsizei)mip.height, 0, (GLsizei)mip.bytes, src);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, (GLint)t.internalFormat, (GLsizei)mip.width, (GLsizei)mip.height, 0, t.format, t.type, src);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // levels [level, last] are now a consistent chain; sample only those
+    if (level == (int)t.mips.size() - 1)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    --job.nextLevel;
+    return (size_t)mip.bytes;
+}
+
+void TextureStreamer::update(size_t budgetBytes)
+{
+    PROFILE_SCOPE("TextureStreamer::update");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!done_.empty())
+        {
+            std::unique_ptr<Job> job = std::move(done_.front());
+            done_.pop_front();
+            if (!job->ok)
+                continue; // keeps the placeholder
+            job->nextLevel = (int)job->result.mips.size() - 1;
+            uploading_.push_back(std::move(job));
+        }
+    }
+    if (uploading_.empty())
+        return;
+
+    if (!pbo_)
+        glGenBuffers(1, &pbo_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t spent = 0;
+    while (!uploading_.empty())
+    {
+        Job &job = *uploading_.front();
+        // only the first level of a frame may exceed the budget on its own
+        if (spent > 0 && spent + job.result.mips[job.nextLevel].bytes > budgetBytes)
+            break;
+        spent += uploadLevel(job);
+        if (job.nextLevel < 0)
+        {
+            uploading_.pop_front();
+            ++uploadedTextures_;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    uploadedBytes_ += spent;
+    ++uploadFrames_;
+    if (pending() == 0)
+    {
+        std::fprintf(stderr, "TextureStreamer: %zu textures, %.1f MB uploaded over %u frames\n", uploadedTextures_,
+                     uploadedBytes_ / (1024.0 * 1024.0), uploadFrames_);
+        uploadedBytes_ = uploadedTextures_ = 0;
+        uploadFrames_ = 0;
+    }
+}
+
+void TextureStreamer::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queued_.clear();
+    }
+    wake_.notify_all();
+    for (auto &w : workers_)
+        w.join();
+    workers_.clear();
+    done_.clear();
+    uploading_.clear();
+    if (pbo_)
+    {
+        glDeleteBuffers(1, &pbo_);
+        pbo_ = 0;
+    }
+}
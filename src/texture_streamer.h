@@ -0,0 +1,76 @@
+#pragma once
+#include <glad/gl.h>
+#include "model_cache.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background texture loading. Images are produced (decoded, or paged in from a
+// cooked file) on a worker pool; finished mip chains are uploaded from the GL
+// thread through a pixel-unpack buffer, coarsest level first, within a per-frame
+// byte budget. The texture name handed out is usable at once: it samples a
+// 1x1 placeholder until its first level lands, then sharpens in place as
+// GL_TEXTURE_BASE_LEVEL walks down to 0.
+class TextureStreamer
+{
+public:
+    // Runs on a worker: fill `out` with a complete mip chain. Level pointers may
+    // point into `storage` or into anything the function object keeps alive.
+    using ProduceFn = std::function<bool(CookedModel &storage, CookedTexture &out)>;
+
+    static constexpr size_t kDefaultBudget = 8u << 20;
+
+    ~TextureStreamer() { shutdown(); }
+
+    // GL thread only
+    GLuint request(ProduceFn produce, const uint8_t placeholder[4]);
+    // Decode and cook an image file (block compressed when the driver has S3TC)
+    GLuint requestFile(const std::string &path, TextureUsage usage, const uint8_t placeholder[4]);
+    // Must precede glDeleteTextures on a name that may still be streaming
+    void cancel(GLuint tex);
+    // Upload finished levels until budgetBytes is spent (always at least one level)
+    void update(size_t budgetBytes = kDefaultBudget);
+    size_t pending() const;
+    // Join the workers and drop outstanding work; call while the context is current
+    void shutdown();
+
+private:
+    struct Job
+    {
+        GLuint tex = 0;
+        ProduceFn produce;
+        CookedModel storage;
+        CookedTexture result;
+        bool ok = false;
+        int nextLevel = -1; // counts down to 0 while uploading
+        bool cancelled = false;
+    };
+
+    void startWorkers();
+    void workerLoop();
+    // Returns bytes uploaded
+    size_t uploadLevel(Job &job);
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::unique_ptr<Job>> queued_; // waiting for a worker
+    std::deque<std::unique_ptr<Job>> done_;   // produced, waiting for the GL thread
+    std::vector<Job *> producing_;            // held by a worker right now
+    std::vector<std::thread> workers_;
+    bool stopping_ = false;
+
+    // GL thread only
+    std::deque<std::unique_ptr<Job>> uploading_;
+    GLuint pbo_ = 0;
+    size_t uploadedBytes_ = 0, uploadedTextures_ = 0;
+    unsigned uploadFrames_ = 0;
+};
+
+TextureStreamer &textureStreamer();
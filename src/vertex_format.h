@@ -0,0 +1,164 @@
+#pragma once
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Compile-time vertex layouts. Each attribute type carries its GL description
+// and packs one value into its storage; VertexLayout<A...> places them back to
+// back at locations 0..N-1 and derives both the packing and the
+// glVertexAttribPointer setup from that single list.
+namespace vertex
+{
+
+// IEEE half, round to nearest even; overflow goes to infinity
+inline uint16_t floatToHalf(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    const uint32_t fexp = (x >> 23) & 0xffu;
+    uint32_t mant = x & 0x7fffffu;
+    if (fexp == 0xffu)
+        return (uint16_t)(sign | 0x7c00u | (mant ? 0x200u : 0u));
+    const int exp = (int)fexp - 127 + 15;
+    if (exp >= 31)
+        return (uint16_t)(sign | 0x7c00u);
+    if (exp <= 0)
+    {
+        if (exp < -10)
+            return (uint16_t)sign;
+        mant |= 0x800000u;
+        const uint32_t shift = (uint32_t)(14 - exp);
+        uint32_t h = mant >> shift;
+        const uint32_t rem = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (h & 1u)))
+            ++h;
+        return (uint16_t)(sign | h);
+    }
+    uint32_t h = sign | ((uint32_t)exp << 10) | (mant >> 13);
+    const uint32_t rem = mant & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1u)))
+        ++h; // a carry out of the mantissa correctly bumps the exponent
+    return (uint16_t)h;
+}
+
+// Signed normalized integer of `bits` width, two's complement, masked to the field
+inline uint32_t snorm(float v, int bits)
+{
+    const float scale = (float)((1 << (bits - 1)) - 1);
+    const int32_t q = (int32_t)std::lround(std::min(std::max(v, -1.0f), 1.0f) * scale);
+    return (uint32_t)q & ((1u << bits) - 1);
+}
+
+struct Float2
+{
+    using Value = glm::vec2;
+    static constexpr size_t kSize = 2 * sizeof(float);
+    static constexpr GLint kComponents = 2;
+    static constexpr GLenum kType = GL_FLOAT;
+    static constexpr GLboolean kNormalized = GL_FALSE;
+    static void pack(uint8_t *dst, const Value &v)
+    {
+        const float f[2] = {v.x, v.y};
+        std::memcpy(dst, f, kSize);
+    }
+};
+
+struct Float3
+{
+    using Value = glm::vec3;
+    static constexpr size_t kSize = 3 * sizeof(float);
+    static constexpr GLint kComponents = 3;
+    static constexpr GLenum kType = GL_FLOAT;
+    static constexpr GLboolean kNormalized = GL_FALSE;
+    static void pack(uint8_t *dst, const Value &v)
+    {
+        const float f[3] = {v.x, v.y, v.z};
+        std::memcpy(dst, f, kSize);
+    }
+};
+
+// Texture coordinates within a few hundred repeats of the origin
+struct Half2
+{
+    using Value = glm::vec2;
+    static constexpr size_t kSize = 2 * sizeof(uint16_t);
+    static constexpr GLint kComponents = 2;
+    static constexpr GLenum kType = GL_HALF_FLOAT;
+    static constexpr GLboolean kNormalized = GL_FALSE;
+    static void pack(uint8_t *dst, const Value &v)
+    {
+        const uint16_t h[2] = {floatToHalf(v.x), floatToHalf(v.y)};
+        std::memcpy(dst, h, kSize);
+    }
+};
+
+// Unit direction in 10:10:10 snorm (the 2-bit w is left 0)
+struct Snorm10x3
+{
+    using Value = glm::vec3;
+    static constexpr size_t kSize = sizeof(uint32_t);
+    static constexpr GLint kComponents = 4;
+    static constexpr GLenum kType = GL_INT_2_10_10_10_REV;
+    static constexpr GLboolean kNormalized = GL_TRUE;
+    static void pack(uint8_t *dst, const Value &v)
+    {
+        const uint32_t bits = snorm(v.x, 10) | (snorm(v.y, 10) << 10) | (snorm(v.z, 10) << 20);
+        std::memcpy(dst, &bits, kSize);
+    }
+};
+
+// Tangent xyz in 10:10:10 snorm plus the bitangent sign in w. GL versions
+// disagree on how a 2-bit snorm -1 decodes, so shaders should test w < 0.
+struct Snorm10x3Sign
+{
+    using Value = glm::vec4;
+    static constexpr size_t kSize = sizeof(uint32_t);
+    static constexpr GLint kComponents = 4;
+    static constexpr GLenum kType = GL_INT_2_10_10_10_REV;
+    static constexpr GLboolean kNormalized = GL_TRUE;
+    static void pack(uint8_t *dst, const Value &v)
+    {
+        const uint32_t w = v.w < 0.0f ? 3u : 1u; // -1 / +1
+        const uint32_t bits = snorm(v.x, 10) | (snorm(v.y, 10) << 10) | (snorm(v.z, 10) << 20) | (w << 30);
+        std::memcpy(dst, &bits, kSize);
+    }
+};
+
+} // namespace vertex
+
+template <class... Attribs>
+struct VertexLayout
+{
+    static constexpr size_t kStride = (Attribs::kSize + ... + 0);
+    static_assert(kStride % 4 == 0, "attributes must stay 4-byte aligned");
+
+    struct Vertex
+    {
+        uint8_t bytes[kStride];
+    };
+
+    // One value per attribute, in declaration order
+    static Vertex pack(const typename Attribs::Value &...values)
+    {
+        Vertex v;
+        size_t offset = 0;
+        ((Attribs::pack(v.bytes + offset, values), offset += Attribs::kSize), ...);
+        return v;
+    }
+
+    // Attribute pointers for the bound VAO and GL_ARRAY_BUFFER
+    static void setup(GLuint firstLocation = 0)
+    {
+        GLuint location = firstLocation;
+        size_t offset = 0;
+        ((glEnableVertexAttribArray(location),
+          glVertexAttribPointer(location, Attribs::kComponents, Attribs::kType, Attribs::kNormalized, (GLsizei)kStride, (void *)offset),
+          ++location, offset += Attribs::kSize),
+         ...);
+    }
+};
@@ -0,0 +1,210 @@
+#include "voxel_storage.h"
+#include <algorithm>
+
+void VoxelChunk::writeIndex(int i, uint32_t p)
+{
+    size_t bit = (size_t)i * bitsPerCell_;
+    uint64_t mask = ((uint64_t(1) << bitsPerCell_) - 1) << (bit & 63);
+    uint64_t &w = bits_[bit >> 6];
+    w = (w & ~mask) | (((uint64_t)p << (bit & 63)) & mask);
+}
+
+void VoxelChunk::repack(int newBits)
+{
+    std::vector<uint64_t> old;
+    old.swap(bits_);
+    const int oldBits = bitsPerCell_;
+    bits_.assign((size_t)kCells * newBits / 64, 0);
+    bitsPerCell_ = (uint8_t)newBits;
+    if (oldBits == 0) return; // was uniform: every index is palette slot 0
+    for (int i = 0; i < kCells; ++i)
+    {
+        size_t bit = (size_t)i * oldBits;
+        uint32_t p = (uint32_t)((old[bit >> 6] >> (bit & 63)) & ((uint64_t(1) << oldBits) - 1));
+        writeIndex(i, p);
+    }
+}
+
+bool VoxelChunk::set(int x, int y, int z, VoxelCell v)
+{
+    if (get(x, y, z) == v) return false;
+    auto it = std::find(palette_.begin(), palette_.end(), v);
+    uint32_t p = (uint32_t)(it - palette_.begin());
+    if (it == palette_.end())
+    {
+        palette_.push_back(v);
+        // widen when the palette outgrows the current index width (1, 2, 4, 8, 16 bits)
+        int need = bitsPerCell_ ? bitsPerCell_ : 1;
+        while ((size_t(1) << need) < palette_.size()) need *= 2;
+        if (need != bitsPerCell_) repack(need);
+    }
+    writeIndex(cellIndex(x, y, z), p);
+    dirty = true;
+    return true;
+}
+
+void VoxelChunk::fill(VoxelCell v)
+{
+    if (isUniform() && palette_[0] == v) return;
+    palette_.assign(1, v);
+    palette_.shrink_to_fit();
+    bits_.clear();
+    bits_.shrink_to_fit();
+    bitsPerCell_ = 0;
+    dirty = true;
+}
+
+void VoxelChunk::compact()
+{
+    if (isUniform()) return;
+    std::vector<uint32_t> used(palette_.size(), 0);
+    for (int i = 0; i < kCells; ++i) ++used[readIndex(i)];
+    std::vector<uint32_t> remap(palette_.size(), 0);
+    std::vector<VoxelCell> pal;
+    for (size_t p = 0; p < palette_.size(); ++p)
+    {
+        if (!used[p]) continue;
+        remap[p] = (uint32_t)pal.size();
+        pal.push_back(palette_[p]);
+    }
+    if (pal.size() == 1)
+    {
+        palette_ = pal;
+        bits_.clear();
+        bits_.shrink_to_fit();
+        bitsPerCell_ = 0;
+        return;
+    }
+    int need = 1;
+    while ((size_t(1) << need) < pal.size()) need *= 2;
+    std::vector<uint32_t> idx(kCells);
+    for (int i = 0; i < kCells; ++i) idx[i] = remap[readIndex(i)];
+    palette_ = std::move(pal);
+    palette_.shrink_to_fit();
+    bits_.assign((size_t)kCells * need / 64, 0);
+    bits_.shrink_to_fit();
+    bitsPerCell_ = (uint8_t)need;
+    for (int i = 0; i < kCells; ++i) writeIndex(i, idx[i]);
+}
+
+size_t VoxelChunk::solidCount() const
+{
+    if (isUniform()) return palette_[0] ? (size_t)kCells : 0;
+    size_t n = 0;
+    for (int i = 0; i < kCells; ++i)
+        if (palette_[readIndex(i)]) ++n;
+    return n;
+}
+
+VoxelChunk *VoxelStorage::find(const glm::ivec3 &cc)
+{
+    auto it = chunks_.find(packKey(cc));
+    return it != chunks_.end() ? &it->second : nullptr;
+}
+
+const VoxelChunk *VoxelStorage::find(const glm::ivec3 &cc) const
+{
+    auto it = chunks_.find(packKey(cc));
+    return it != chunks_.end() ? &it->second : nullptr;
+}
+
+void VoxelStorage::markDirty(const glm::ivec3 &cc)
+{
+    if (VoxelChunk *ch = find(cc)) ch->dirty = true;
+}
+
+VoxelCell VoxelStorage::cell(const glm::ivec3 &c) const
+{
+    glm::ivec3 cc = chunkOf(c);
+    const VoxelChunk *ch = find(cc);
+    if (!ch) return 0;
+    glm::ivec3 l = c - cc * VoxelChunk::kSize;
+    return ch->get(l.x, l.y, l.z);
+}
+
+void VoxelStorage::setCell(const glm::ivec3 &c, VoxelCell v)
+{
+    const int S = VoxelChunk::kSize;
+    glm::ivec3 cc = chunkOf(c);
+    VoxelChunk *ch = find(cc);
+    if (!ch)
+    {
+        if (!v) return;
+        ch = &chunks_.emplace(packKey(cc), VoxelChunk()).first->second;
+    }
+    glm::ivec3 l = c - cc * S;
+    if (!ch->set(l.x, l.y, l.z, v)) return;
+    // faces on a chunk border are meshed by whichever side is solid
+    for (int a = 0; a < 3; ++a)
+    {
+        glm::ivec3 n = cc;
+        if (l[a] == 0) { n[a] -= 1; markDirty(n); }
+        if (l[a] == S - 1) { n[a] += 1; markDirty(n); }
+    }
+}
+
+void VoxelStorage::fillBox(const glm::ivec3 &lo, const glm::ivec3 &hi, VoxelCell v)
+{
+    if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+    const int S = VoxelChunk::kSize;
+    glm::ivec3 c0 = chunkOf(lo), c1 = chunkOf(hi - glm::ivec3(1));
+    for (int cz = c0.z; cz <= c1.z; ++cz)
+        for (int cy = c0.y; cy <= c1.y; ++cy)
+            for (int cx = c0.x; cx <= c1.x; ++cx)
+            {
+                glm::ivec3 cc(cx, cy, cz);
+                glm::ivec3 base = cc * S;
+                glm::ivec3 a = glm::max(lo, base) - base;
+                glm::ivec3 b = glm::min(hi, base + glm::ivec3(S)) - base;
+                VoxelChunk *ch = find(cc);
+                if (!ch)
+                {
+                    if (!v) continue;
+                    ch = &chunks_.emplace(packKey(cc), VoxelChunk()).first->second;
+                }
+                if (a == glm::ivec3(0) && b == glm::ivec3(S))
+                {
+                    ch->fill(v);
+                    continue;
+                }
+                for (int z = a.z; z < b.z; ++z)
+                    for (int y = a.y; y < b.y; ++y)
+                        for (int x = a.x; x < b.x; ++x)
+                            ch->set(x, y, z, v);
+            }
+    // neighbours across the box faces may gain or lose border faces
+    for (int cz = c0.z - 1; cz <= c1.z + 1; ++cz)
+        for (int cy = c0.y - 1; cy <= c1.y + 1; ++cy)
+            for (int cx = c0.x - 1; cx <= c1.x + 1; ++cx)
+                if (cx < c0.x || cx > c1.x || cy < c0.y || cy > c1.y || cz < c0.z || cz > c1.z)
+                    markDirty({cx, cy, cz});
+}
+
+void VoxelStorage::compact()
+{
+    for (auto it = chunks_.begin(); it != chunks_.end();)
+    {
+        it->second.compact();
+        // empty chunks only matter while their neighbours still need a re-mesh
+        if (it->second.isEmpty() && !it->second.dirty)
+            it = chunks_.erase(it);
+        else
+            ++it;
+    }
+}
+
+size_t VoxelStorage::memoryBytes() const
+{
+    // key + chunk + per-node bookkeeping (next pointer, cached hash)
+    size_t bytes = chunks_.bucket_count() * sizeof(void *);
+    for (const auto &kv : chunks_)
+        bytes += sizeof(kv.first) + 2 * sizeof(void *) + kv.second.memoryBytes();
+    return bytes;
+}
+
+size_t VoxelStorage::solidCount() const
+{
+    size_t n = 0;
+    for (const auto &kv : chunks_) n += kv.second.solidCount();
+    return n;
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Cell value: 0 = empty, anything else is a solid material id
+using VoxelCell = uint16_t;
+
+// Fixed-size block of cells. A chunk whose cells all hold the same value (all
+// empty or all one material) is just that value; otherwise cells are indices
+// into a small palette, bit-packed at 1/2/4/8/16 bits per cell.
+class VoxelChunk
+{
+public:
+    static constexpr int kSize = 16;
+    static constexpr int kCells = kSize * kSize * kSize;
+
+    explicit VoxelChunk(VoxelCell fill = 0) : palette_{fill} {}
+
+    VoxelCell get(int x, int y, int z) const
+    {
+        if (bitsPerCell_ == 0) return palette_[0];
+        return palette_[readIndex(cellIndex(x, y, z))];
+    }
+    // Returns true if the cell changed
+    bool set(int x, int y, int z, VoxelCell v);
+    void fill(VoxelCell v);
+    // Drop unused palette entries, shrink the bit width, collapse to uniform when possible
+    void compact();
+
+    bool isUniform() const { return bitsPerCell_ == 0; }
+    VoxelCell uniformValue() const { return palette_[0]; }
+    bool isEmpty() const { return isUniform() && palette_[0] == 0; }
+    size_t solidCount() const;
+    size_t memoryBytes() const { return sizeof(*this) + palette_.capacity() * sizeof(VoxelCell) + bits_.capacity() * sizeof(uint64_t); }
+
+    bool dirty = true; // surface needs re-meshing
+
+private:
+    static int cellIndex(int x, int y, int z) { return (z * kSize + y) * kSize + x; }
+    uint32_t readIndex(int i) const
+    {
+        size_t bit = (size_t)i * bitsPerCell_;
+        return (uint32_t)((bits_[bit >> 6] >> (bit & 63)) & ((uint64_t(1) << bitsPerCell_) - 1));
+    }
+    void writeIndex(int i, uint32_t p);
+    void repack(int newBits);
+
+    std::vector<VoxelCell> palette_;
+    std::vector<uint64_t> bits_; // empty while uniform
+    uint8_t bitsPerCell_ = 0;    // 0 = uniform
+};
+
+// Sparse, unbounded cell grid: a hash of chunks keyed by chunk coordinate.
+// Chunks that were never written are empty and cost nothing.
+class VoxelStorage
+{
+public:
+    void clear() { chunks_.clear(); }
+
+    VoxelCell cell(const glm::ivec3 &c) const;
+    bool solid(const glm::ivec3 &c) const { return cell(c) != 0; }
+    void setCell(const glm::ivec3 &c, VoxelCell v);
+    // Fill the half-open cell box [lo, hi); fully covered chunks become uniform directly
+    void fillBox(const glm::ivec3 &lo, const glm::ivec3 &hi, VoxelCell v);
+    void compact();
+
+    // fn(const glm::ivec3 &cell, VoxelCell v) for every solid cell in [lo, hi)
+    template <class Fn>
+    void forEachCell(const glm::ivec3 &lo, const glm::ivec3 &hi, Fn &&fn) const;
+    // fn(const glm::ivec3 &chunkCoord, const VoxelChunk &chunk)
+    template <class Fn>
+    void forEachChunk(Fn &&fn) const
+    {
+        for (const auto &kv : chunks_) fn(unpackKey(kv.first), kv.second);
+    }
+
+    // Per-chunk dirty flags: set on any change to the chunk or a face-adjacent cell
+    template <class Fn>
+    void forEachDirtyChunk(Fn &&fn) const
+    {
+        for (const auto &kv : chunks_)
+            if (kv.second.dirty) fn(unpackKey(kv.first), kv.second);
+    }
+    void clearDirty()
+    {
+        for (auto &kv : chunks_) kv.second.dirty = false;
+    }
+
+    size_t chunkCount() const { return chunks_.size(); }
+    size_t memoryBytes() const;
+    size_t solidCount() const;
+
+    static glm::ivec3 chunkOf(const glm::ivec3 &c) { return {floorDiv(c.x), floorDiv(c.y), floorDiv(c.z)}; }
+    // 21 bits per axis, two's complement
+    static uint64_t packKey(const glm::ivec3 &cc)
+    {
+        const uint64_t m = (1u << 21) - 1;
+        return ((uint64_t)(cc.x & m) << 42) | ((uint64_t)(cc.y & m) << 21) | (uint64_t)(cc.z & m);
+    }
+
+private:
+    static int floorDiv(int v) { return v >= 0 ? v / VoxelChunk::kSize : (v - VoxelChunk::kSize + 1) / VoxelChunk::kSize; }
+    static glm::ivec3 unpackKey(uint64_t k)
+    {
+        auto sx = [](uint64_t v) { return (int)(v & (1u << 20) ? v | ~uint64_t((1u << 21) - 1) : v); };
+        const uint64_t m = (1u << 21) - 1;
+        return {sx((k >> 42) & m), sx((k >> 21) & m), sx(k & m)};
+    }
+    VoxelChunk *find(const glm::ivec3 &cc);
+    const VoxelChunk *find(const glm::ivec3 &cc) const;
+    void markDirty(const glm::ivec3 &cc);
+
+    std::unordered_map<uint64_t, VoxelChunk> chunks_;
+};
+
+template <class Fn>
+void VoxelStorage::forEachCell(const glm::ivec3 &lo, const glm::ivec3 &hi, Fn &&fn) const
+{
+    if (lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z) return;
+    const int S = VoxelChunk::kSize;
+    glm::ivec3 c0 = chunkOf(lo), c1 = chunkOf(hi - glm::ivec3(1));
+    for (int cz = c0.z; cz <= c1.z; ++cz)
+        for (int cy = c0.y; cy <= c1.y; ++cy)
+            for (int cx = c0.x; cx <= c1.x; ++cx)
+            {
+                const VoxelChunk *ch = find({cx, cy, cz});
+                if (!ch || ch->isEmpty()) continue;
+                glm::ivec3 base(cx * S, cy * S, cz * S);
+                glm::ivec3 a = glm::max(lo, base) - base;
+                glm::ivec3 b = glm::min(hi, base + glm::ivec3(S)) - base;
+                for (int z = a.z; z < b.z; ++z)
+                    for (int y = a.y; y < b.y; ++y)
+                        for (int x = a.x; x < b.x; ++x)
+                        {
+                            VoxelCell v = ch->get(x, y, z);
+                            if (v) fn(base + glm::ivec3(x, y, z), v);
+                        }
+            }
+}
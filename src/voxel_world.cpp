@@ -1,13 +1,193 @@
 #include "voxel_world.h"
 #include "level.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+// Largest power-of-two cell (1m down to 1/8m) that every box boundary lands on
+static float chooseCellSize(const Level& level){
+    float cell = 1.0f;
+    for (int attempt = 0; attempt < 4; ++attempt, cell *= 0.5f){
+        bool aligned = true;
+        for (const auto& inst : level.instances()){
+            for (int a = 0; a < 3 && aligned; ++a){
+                float lo = (inst.position[a] - inst.scale[a] * 0.5f) / cell;
+                float hi = (inst.position[a] + inst.scale[a] * 0.5f) / cell;
+                aligned = std::fabs(lo - std::round(lo)) < 1e-3f && std::fabs(hi - std::round(hi)) < 1e-3f;
+            }
+            if (!aligned) break;
+        }
+        if (aligned) return cell;
+    }
+    return cell * 2.0f; // finest tried; misaligned boxes snap to it
+}
 
 void VoxelWorld::buildFromLevel(const Level& level){
-    voxels_.clear();
     colliders_.clear();
     for (const auto& inst : level.instances()){
-        Voxel v; v.center = inst.position; v.size = inst.scale; voxels_.push_back(v);
-        glm::vec3 he = v.size * 0.5f * collisionScale_;
-        glm::vec3 c = v.center; // keep center in world units
+        glm::vec3 he = inst.scale * 0.5f * collisionScale_;
+        glm::vec3 c = inst.position; // keep center in world units
         colliders_.push_back({c - he, c + he});
     }
+
+    // Rasterize boxes into the chunked cell grid
+    cells_.clear();
+    chunkMeshes_.clear();
+    cellSize_ = chooseCellSize(level);
+    size_t snapped = 0;
+    float maxSnap = 0.0f;
+    for (const auto& inst : level.instances()){
+        glm::ivec3 lo, hi;
+        bool moved = false;
+        for (int a = 0; a < 3; ++a){
+            float flo = (inst.position[a] - inst.scale[a] * 0.5f) / cellSize_;
+            float fhi = (inst.position[a] + inst.scale[a] * 0.5f) / cellSize_;
+            lo[a] = (int)std::lround(flo);
+            hi[a] = (int)std::lround(fhi);
+            if (hi[a] <= lo[a]) hi[a] = lo[a] + 1; // thinner than a cell: still rasterize one
+            float err = std::max(std::fabs(lo[a] - flo), std::fabs(hi[a] - fhi)) * cellSize_;
+            if (err >= 1e-3f * cellSize_){
+                moved = true;
+                maxSnap = std::max(maxSnap, err);
+            }
+        }
+        if (moved) ++snapped;
+        cells_.fillBox(lo, hi, 1);
+    }
+    cells_.compact();
+    if (snapped)
+        std::fprintf(stderr, "VoxelWorld: warning: %zu boxes off the %.3fm grid were snapped (rendered surface off by up to %.3fm; collision is unchanged)\n",
+                     snapped, cellSize_, maxSnap);
+
+    size_t solid = cells_.solidCount();
+    std::fprintf(stderr, "VoxelWorld: %zu boxes -> %zu solid cells in %zu chunks (cell %.3fm), %zu bytes (%.3f bits/solid cell)\n",
+                 level.instances().size(), solid, cells_.chunkCount(), cellSize_, cells_.memoryBytes(),
+                 solid ? cells_.memoryBytes() * 8.0 / (double)solid : 0.0);
+    updateMesh();
+}
+
+void VoxelWorld::updateMesh(){
+    size_t rebuilt = 0;
+    cells_.forEachDirtyChunk([&](const glm::ivec3& cc, const VoxelChunk&){
+        uint64_t key = VoxelStorage::packKey(cc);
+        ChunkMesh mesh;
+        meshChunk(cc, mesh);
+        if (mesh.indices.empty()) chunkMeshes_.erase(key);
+        else chunkMeshes_[key] = std::move(mesh);
+        ++rebuilt;
+    });
+    cells_.clearDirty();
+    cells_.compact(); // drop chunks that only stayed around to be re-meshed
+    if (!rebuilt) return;
+
+    // Concatenate per-chunk meshes into the single static surface
+    meshVertices_.clear();
+    meshIndices_.clear();
+    meshRanges_.clear();
+    for (const auto& kv : chunkMeshes_){
+        uint32_t first = (uint32_t)meshVertices_.size();
+        VoxelMeshRange range;
+        range.firstIndex = (uint32_t)meshIndices_.size();
+        range.indexCount = (uint32_t)kv.second.indices.size();
+        range.boundsMin = kv.second.boundsMin;
+        range.boundsMax = kv.second.boundsMax;
+        meshRanges_.push_back(range);
+        meshVertices_.insert(meshVertices_.end(), kv.second.vertices.begin(), kv.second.vertices.end());
+        for (uint32_t i : kv.second.indices) meshIndices_.push_back(first + i);
+    }
+    ++meshRevision_;
+    std::fprintf(stderr, "VoxelWorld: re-meshed %zu chunks -> %zu quads total\n", rebuilt, meshVertices_.size() / 4);
+}
+
+// Greedy meshing of one chunk: for each axis sweep the slices between cells,
+// build a mask of faces whose two sides differ in occupancy, then grow maximal
+// rectangles. Faces on a chunk border belong to the chunk holding the solid cell.
+void VoxelWorld::meshChunk(const glm::ivec3& cc, ChunkMesh& out) const{
+    const int S = VoxelChunk::kSize, P = S + 2;
+    const glm::ivec3 base = cc * S;
+
+    // Occupancy with a one-cell border taken from the neighbouring chunks
+    std::vector<uint8_t> occ((size_t)P * P * P, 0);
+    cells_.forEachCell(base - glm::ivec3(1), base + glm::ivec3(S + 1), [&](const glm::ivec3& c, VoxelCell){
+        glm::ivec3 l = c - base + glm::ivec3(1);
+        occ[((size_t)l.z * P + l.y) * P + l.x] = 1;
+    });
+    auto solid = [&](const int p[3]) -> bool {
+        return occ[((size_t)(p[2] + 1) * P + (p[1] + 1)) * P + (p[0] + 1)] != 0;
+    };
+
+    std::vector<int8_t> mask((size_t)S * S);
+    for (int d = 0; d < 3; ++d){
+        // (d, u, v) is a cyclic permutation of (x, y, z), so u x v points along +d
+        const int u = (d + 1) % 3, v = (d + 2) % 3;
+        int x[3] = {0, 0, 0};
+        for (x[d] = -1; x[d] < S; ){
+            // +1: face looks along +d, -1: along -d, 0: no face (both sides equal)
+            size_t n = 0;
+            for (x[v] = 0; x[v] < S; ++x[v]){
+                for (x[u] = 0; x[u] < S; ++x[u], ++n){
+                    int nb[3] = {x[0], x[1], x[2]};
+                    nb[d] += 1;
+                    bool a = solid(x), b = solid(nb);
+                    int8_t c = (a == b) ? 0 : (a ? 1 : -1);
+                    // the solid side must be inside this chunk
+                    if ((c > 0 && x[d] < 0) || (c < 0 && nb[d] >= S)) c = 0;
+                    mask[n] = c;
+                }
+            }
+            ++x[d];
+            n = 0;
+            for (int j = 0; j < S; ++j){
+                for (int i = 0; i < S; ){
+                    const int8_t c = mask[n];
+                    if (!c){ ++i; ++n; continue; }
+                    int w = 1;
+                    while (i + w < S && mask[n + w] == c) ++w;
+                    int h = 1;
+                    for (; j + h < S; ++h){
+                        bool rowOk = true;
+                        for (int k = 0; k < w && rowOk; ++k)
+                            rowOk = mask[n + k + (size_t)h * S] == c;
+                        if (!rowOk) break;
+                    }
+
+                    // Emit the quad in world space
+                    glm::vec3 corner[4];
+                    int q0[3] = {x[0], x[1], x[2]};
+                    q0[u] = i; q0[v] = j;
+                    for (int q = 0; q < 4; ++q){
+                        int p[3] = {q0[0], q0[1], q0[2]};
+                        if (q == 1 || q == 2) p[u] += w;
+                        if (q == 2 || q == 3) p[v] += h;
+                        corner[q] = glm::vec3(base + glm::ivec3(p[0], p[1], p[2])) * cellSize_;
+                    }
+                    glm::vec3 normal(0.0f);
+                    normal[d] = (float)c;
+                    uint32_t first = (uint32_t)out.vertices.size();
+                    for (int q = 0; q < 4; ++q){
+                        // same axis pairs as the box projection in pbr.frag
+                        glm::vec2 uv;
+                        if (d == 0) uv = glm::vec2(corner[q].z, corner[q].y);
+                        else if (d == 1) uv = glm::vec2(corner[q].x, corner[q].z);
+                        else uv = glm::vec2(corner[q].x, corner[q].y);
+                        out.vertices.push_back(VoxelVertexFormat::pack(corner[q], normal, uv));
+                    }
+                    if (first == 0) out.boundsMin = out.boundsMax = corner[0];
+                    out.boundsMin = glm::min(out.boundsMin, glm::min(corner[0], corner[2]));
+                    out.boundsMax = glm::max(out.boundsMax, glm::max(corner[0], corner[2]));
+                    // CCW seen from the side the face looks at
+                    if (c > 0){
+                        for (uint32_t k : {0u, 1u, 2u, 0u, 2u, 3u}) out.indices.push_back(first + k);
+                    } else {
+                        for (uint32_t k : {0u, 2u, 1u, 0u, 3u, 2u}) out.indices.push_back(first + k);
+                    }
+
+                    for (int l = 0; l < h; ++l)
+                        for (int k = 0; k < w; ++k)
+                            mask[n + k + (size_t)l * S] = 0;
+                    i += w; n += w;
+                }
+            }
+        }
+    }
 }
@@ -1,23 +1,64 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 #include "controller.h" // for AABB
+#include "vertex_format.h"
+#include "voxel_storage.h"
 
 class Level;
 
-struct Voxel {
-    glm::vec3 center{0};
-    glm::vec3 size{1};
+// pos, normal, uv: 20 bytes. The uv is world-space (box projection), too large for halves.
+using VoxelVertexFormat = VertexLayout<vertex::Float3, vertex::Snorm10x3, vertex::Float2>;
+using VoxelVertex = VoxelVertexFormat::Vertex;
+
+// Span of meshIndices() produced by one chunk, with its world-space bounds
+struct VoxelMeshRange {
+    uint32_t firstIndex = 0, indexCount = 0;
+    glm::vec3 boundsMin{0.0f}, boundsMax{0.0f};
 };
 
 class VoxelWorld {
 public:
     void buildFromLevel(const Level& level);
-    const std::vector<Voxel>& voxels() const { return voxels_; }
     const std::vector<AABB>& colliders() const { return colliders_; }
     void setCollisionScale(float s) { collisionScale_ = s; }
+
+    // Cell grid: cell c covers [c, c+1) * cellSize() in world units
+    const VoxelStorage& cells() const { return cells_; }
+    float cellSize() const { return cellSize_; }
+    void setCell(const glm::ivec3& c, VoxelCell v) { cells_.setCell(c, v); }
+    // Re-mesh the chunks whose cells (or neighbours) changed since the last call
+    void updateMesh();
+
+    // Static surface mesh: interior faces removed, coplanar faces greedily merged
+    // within each chunk. World-space positions; uv follows the box projection used
+    // by uUseBoxUVMapping.
+    const std::vector<VoxelVertex>& meshVertices() const { return meshVertices_; }
+    const std::vector<uint32_t>& meshIndices() const { return meshIndices_; }
+    // One range per non-empty chunk, for culling
+    const std::vector<VoxelMeshRange>& meshRanges() const { return meshRanges_; }
+    // Bumped whenever the mesh is rebuilt so GPU copies know to re-upload
+    uint32_t meshRevision() const { return meshRevision_; }
+
 private:
-    std::vector<Voxel> voxels_;
+    struct ChunkMesh {
+        std::vector<VoxelVertex> vertices;
+        std::vector<uint32_t> indices;
+        glm::vec3 boundsMin{0.0f}, boundsMax{0.0f};
+    };
+    void meshChunk(const glm::ivec3& cc, ChunkMesh& out) const;
+
     std::vector<AABB> colliders_;
     float collisionScale_ = 1.0f;
+
+    float cellSize_ = 1.0f;
+    VoxelStorage cells_;
+    std::unordered_map<uint64_t, ChunkMesh> chunkMeshes_;
+
+    std::vector<VoxelVertex> meshVertices_;
+    std::vector<uint32_t> meshIndices_;
+    std::vector<VoxelMeshRange> meshRanges_;
+    uint32_t meshRevision_ = 0;
 };